@@ -0,0 +1,513 @@
+#include "bc.h"
+
+#include <cmath>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+/* below this many blocks per thread, spawning threads costs more than it saves. */
+constexpr size_t minBlocksPerThread = 1024;
+
+/* BC6H and BC7 interpolation weights for 4-bit indices, out of 64. */
+static const int weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+/* little-endian bit packing, as every BC format is laid out. */
+struct BitWriter {
+    uint8_t* out;
+    int position;
+
+    BitWriter(uint8_t* out, size_t size) : out(out), position(0) {
+        memset(out, 0, size);
+    }
+
+    void put(uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, position++) {
+            if (value & (1u << i))
+                out[position >> 3] |= 1 << (position & 7);
+        }
+    }
+};
+
+/* the line through a block's points that best fits them (power iteration on
+ * the covariance), returned as the two extreme projections onto it. */
+template<int N>
+static void fitLine(const float (*points)[N], int count, float lo[N], float hi[N])
+{
+    float mean[N] = {};
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < N; c++) {
+            mean[c] += points[i][c] / count;
+        }
+    }
+
+    float covariance[N][N] = {};
+    for (int i = 0; i < count; i++) {
+        for (int a = 0; a < N; a++) {
+            for (int b = 0; b < N; b++) {
+                covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+            }
+        }
+    }
+
+    float axis[N];
+    for (int c = 0; c < N; c++) {
+        axis[c] = 1.0f;
+    }
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[N] = {};
+        for (int a = 0; a < N; a++) {
+            for (int b = 0; b < N; b++) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+        }
+        float length = 0;
+        for (int c = 0; c < N; c++) {
+            length = std::max(length, std::fabs(next[c]));
+        }
+        if (length == 0)
+            break;
+        for (int c = 0; c < N; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float norm = 0;
+    for (int c = 0; c < N; c++) {
+        norm += axis[c] * axis[c];
+    }
+    float tmin = 0, tmax = 0;
+    for (int i = 0; i < count; i++) {
+        float t = 0;
+        for (int c = 0; c < N; c++) {
+            t += (points[i][c] - mean[c]) * axis[c];
+        }
+        tmin = std::min(tmin, t / norm);
+        tmax = std::max(tmax, t / norm);
+    }
+    for (int c = 0; c < N; c++) {
+        lo[c] = mean[c] + axis[c] * tmin;
+        hi[c] = mean[c] + axis[c] * tmax;
+    }
+}
+
+template<int N>
+static int nearest(const float* point, const float (*palette)[N], int count)
+{
+    int best = 0;
+    float bestError = 1e30f;
+    for (int i = 0; i < count; i++) {
+        float error = 0;
+        for (int c = 0; c < N; c++) {
+            float d = point[c] - palette[i][c];
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* least-squares endpoints for fixed indices, where index i lies at
+ * weights[i] of the way from lo to hi. false if the indices are all equal. */
+template<int N>
+static bool refit(const float (*points)[N], const int* indices, const float* weights, float lo[N], float hi[N])
+{
+    float aa = 0, ab = 0, bb = 0, ax[N] = {}, bx[N] = {};
+    for (int i = 0; i < 16; i++) {
+        float b = weights[indices[i]], a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < N; c++) {
+            ax[c] += a * points[i][c];
+            bx[c] += b * points[i][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+        return false;
+    for (int c = 0; c < N; c++) {
+        lo[c] = (ax[c] * bb - bx[c] * ab) / det;
+        hi[c] = (bx[c] * aa - ax[c] * ab) / det;
+    }
+    return true;
+}
+
+static uint16_t pack565(const float* c)
+{
+    int r = std::min(31, std::max(0, (int)std::lround(c[0] * 31.0f / 255.0f)));
+    int g = std::min(63, std::max(0, (int)std::lround(c[1] * 63.0f / 255.0f)));
+    int b = std::min(31, std::max(0, (int)std::lround(c[2] * 31.0f / 255.0f)));
+    return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static void unpack565(uint16_t v, float* c)
+{
+    c[0] = float((v >> 11 & 31) * 255 / 31);
+    c[1] = float((v >> 5 & 63) * 255 / 63);
+    c[2] = float((v & 31) * 255 / 31);
+}
+
+static void encodeBC1(const uint8_t texels[16][4], uint8_t* out)
+{
+    static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3, 2.0f / 3 };
+
+    float points[16][3];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            points[i][c] = texels[i][c];
+        }
+    }
+
+    // quantizes the endpoints and picks indices, returning the squared error.
+    uint16_t c0, c1;
+    int indices[16];
+    auto encode = [&](const float* hi, const float* lo) {
+        // four-color mode needs c0 > c1.
+        c0 = pack565(hi);
+        c1 = pack565(lo);
+        if (c0 < c1)
+            std::swap(c0, c1);
+        float palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        float error = 0;
+        for (int i = 0; i < 16; i++) {
+            indices[i] = c0 == c1 ? 0 : nearest<3>(points[i], palette, 4);
+            for (int c = 0; c < 3; c++) {
+                float d = points[i][c] - palette[indices[i]][c];
+                error += d * d;
+            }
+        }
+        return error;
+    };
+
+    float lo[3], hi[3];
+    fitLine<3>(points, 16, lo, hi);
+    float error = encode(hi, lo);
+    uint16_t best[2] = { c0, c1 };
+    int bestIndices[16];
+    std::copy(indices, indices + 16, bestIndices);
+
+    float start[3], end[3];
+    if (refit<3>(points, indices, weights, start, end) && encode(start, end) < error) {
+        best[0] = c0;
+        best[1] = c1;
+        std::copy(indices, indices + 16, bestIndices);
+    }
+
+    BitWriter bits(out, 8);
+    bits.put(best[0], 16);
+    bits.put(best[1], 16);
+    for (int i = 0; i < 16; i++) {
+        bits.put(bestIndices[i], 2);
+    }
+}
+
+/* one channel in eight-value mode (e0 > e1), as BC4 and BC3/BC5 alpha use it. */
+static void encodeBC4(const uint8_t texels[16][4], int channel, uint8_t* out)
+{
+    int e0 = 0, e1 = 255;
+    for (int i = 0; i < 16; i++) {
+        e0 = std::max(e0, (int)texels[i][channel]);
+        e1 = std::min(e1, (int)texels[i][channel]);
+    }
+
+    BitWriter bits(out, 8);
+    bits.put(e0, 8);
+    bits.put(e1, 8);
+    if (e0 == e1)
+        return;
+
+    float palette[8][1];
+    palette[0][0] = (float)e0;
+    palette[1][0] = (float)e1;
+    for (int i = 1; i < 7; i++) {
+        palette[i + 1][0] = ((7 - i) * e0 + i * e1) / 7.0f;
+    }
+    for (int i = 0; i < 16; i++) {
+        float v = texels[i][channel];
+        bits.put(nearest<1>(&v, palette, 8), 3);
+    }
+}
+
+static void encodeBC7(const uint8_t texels[16][4], uint8_t* out)
+{
+    float points[16][4];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            points[i][c] = texels[i][c];
+        }
+    }
+
+    // mode 6: 7-bit endpoints with one shared low bit (p-bit) each.
+    int endpoints[2][4], pbits[2], indices[16];
+    auto encode = [&](float ends[2][4]) {
+        for (int e = 0; e < 2; e++) {
+            float bestError = 1e30f;
+            for (int p = 0; p < 2; p++) {
+                int q[4];
+                float error = 0;
+                for (int c = 0; c < 4; c++) {
+                    q[c] = std::min(127, std::max(0, (int)std::lround((ends[e][c] - p) / 2)));
+                    float d = (q[c] << 1 | p) - ends[e][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    pbits[e] = p;
+                    std::copy(q, q + 4, endpoints[e]);
+                }
+            }
+        }
+
+        float palette[16][4];
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                int a = endpoints[0][c] << 1 | pbits[0];
+                int b = endpoints[1][c] << 1 | pbits[1];
+                palette[i][c] = float(((64 - weights4[i]) * a + weights4[i] * b + 32) >> 6);
+            }
+        }
+        float error = 0;
+        for (int i = 0; i < 16; i++) {
+            indices[i] = nearest<4>(points[i], palette, 16);
+            for (int c = 0; c < 4; c++) {
+                float d = points[i][c] - palette[indices[i]][c];
+                error += d * d;
+            }
+        }
+        return error;
+    };
+
+    float ends[2][4];
+    fitLine<4>(points, 16, ends[0], ends[1]);
+    float error = encode(ends);
+
+    float weights[16];
+    for (int i = 0; i < 16; i++) {
+        weights[i] = weights4[i] / 64.0f;
+    }
+    float refined[2][4];
+    if (refit<4>(points, indices, weights, refined[0], refined[1])) {
+        int saved[2][4], savedPbits[2], savedIndices[16];
+        std::copy(&endpoints[0][0], &endpoints[0][0] + 8, &saved[0][0]);
+        std::copy(pbits, pbits + 2, savedPbits);
+        std::copy(indices, indices + 16, savedIndices);
+        if (encode(refined) >= error) {
+            std::copy(&saved[0][0], &saved[0][0] + 8, &endpoints[0][0]);
+            std::copy(savedPbits, savedPbits + 2, pbits);
+            std::copy(savedIndices, savedIndices + 16, indices);
+        }
+    }
+
+    // the anchor index is stored without its top bit, so it must be < 8.
+    if (indices[0] >= 8) {
+        std::swap(endpoints[0], endpoints[1]);
+        std::swap(pbits[0], pbits[1]);
+        for (int& index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    BitWriter bits(out, 16);
+    bits.put(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        bits.put(endpoints[0][c], 7);
+        bits.put(endpoints[1][c], 7);
+    }
+    bits.put(pbits[0], 1);
+    bits.put(pbits[1], 1);
+    for (int i = 0; i < 16; i++) {
+        bits.put(indices[i], i == 0 ? 3 : 4);
+    }
+}
+
+static uint16_t toHalf(float value)
+{
+    // BC6H unsigned: negatives clamp to 0, overflow to the largest finite half.
+    if (!(value > 0.0f))
+        return 0;
+    if (value >= 65504.0f)
+        return 0x7bff;
+    int exponent;
+    float mantissa = std::frexp(value, &exponent); // value = mantissa * 2^exponent, mantissa in [0.5, 1)
+    if (exponent < -13) // subnormal
+        return (uint16_t)std::lround(value * 16777216.0f);
+    // a mantissa that rounds up to 1024 carries into the exponent.
+    uint32_t bits = ((uint32_t)(exponent + 14) << 10) + (uint32_t)std::lround((mantissa * 2.0f - 1.0f) * 1024.0f);
+    return (uint16_t)std::min<uint32_t>(bits, 0x7bff);
+}
+
+/* mode 11: one region, 10-bit endpoints, 4-bit indices. Fitting is done on
+ * the unquantized 16-bit values the hardware interpolates, where half
+ * floats are close to logarithmic. */
+static void encodeBC6H(const float texels[16][4], uint8_t* out)
+{
+    float points[16][3];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            points[i][c] = toHalf(texels[i][c]) * 64.0f / 31.0f;
+        }
+    }
+
+    int endpoints[2][3], indices[16];
+    auto encode = [&](float ends[2][3]) {
+        for (int e = 0; e < 2; e++) {
+            for (int c = 0; c < 3; c++) {
+                endpoints[e][c] = std::min(1023, std::max(0, (int)std::lround((ends[e][c] - 32.0f) / 64.0f)));
+            }
+        }
+
+        float palette[16][3];
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                int unquantized[2];
+                for (int e = 0; e < 2; e++) {
+                    int q = endpoints[e][c];
+                    unquantized[e] = q == 0 ? 0 : q == 1023 ? 0xffff : ((q << 16) + 0x8000) >> 10;
+                }
+                palette[i][c] = float(((64 - weights4[i]) * unquantized[0] + weights4[i] * unquantized[1] + 32) >> 6);
+            }
+        }
+        float error = 0;
+        for (int i = 0; i < 16; i++) {
+            indices[i] = nearest<3>(points[i], palette, 16);
+            for (int c = 0; c < 3; c++) {
+                float d = points[i][c] - palette[indices[i]][c];
+                error += d * d;
+            }
+        }
+        return error;
+    };
+
+    float ends[2][3];
+    fitLine<3>(points, 16, ends[0], ends[1]);
+    float error = encode(ends);
+
+    float weights[16];
+    for (int i = 0; i < 16; i++) {
+        weights[i] = weights4[i] / 64.0f;
+    }
+    float refined[2][3];
+    if (refit<3>(points, indices, weights, refined[0], refined[1])) {
+        int saved[2][3], savedIndices[16];
+        std::copy(&endpoints[0][0], &endpoints[0][0] + 6, &saved[0][0]);
+        std::copy(indices, indices + 16, savedIndices);
+        if (encode(refined) >= error) {
+            std::copy(&saved[0][0], &saved[0][0] + 6, &endpoints[0][0]);
+            std::copy(savedIndices, savedIndices + 16, indices);
+        }
+    }
+
+    if (indices[0] >= 8) {
+        std::swap(endpoints[0], endpoints[1]);
+        for (int& index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    BitWriter bits(out, 16);
+    bits.put(0x03, 5);
+    for (int e = 0; e < 2; e++) {
+        for (int c = 0; c < 3; c++) {
+            bits.put(endpoints[e][c], 10);
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        bits.put(indices[i], i == 0 ? 3 : 4);
+    }
+}
+
+/* calls encode(x, y, out) for every block, spreading block rows over threads. */
+template<typename Encode>
+static std::vector<uint8_t> compressBlocks(BC::Format format, int width, int height, Encode encode)
+{
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t size = BC::blockSize(format);
+    std::vector<uint8_t> blocks(size_t(blocksX) * blocksY * size);
+
+    auto rows = [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            for (int x = 0; x < blocksX; x++) {
+                encode(x, y, &blocks[(size_t(y) * blocksX + x) * size]);
+            }
+        }
+    };
+
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), blocksY);
+    threads = std::max<size_t>(1, std::min(threads, size_t(blocksX) * blocksY / minBlocksPerThread));
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) {
+        int begin = (int)(blocksY * t / threads);
+        int end = (int)(blocksY * (t + 1) / threads);
+        pool.emplace_back(rows, begin, end);
+    }
+    rows(0, (int)(blocksY / threads));
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    return blocks;
+}
+
+namespace BC {
+    size_t blockSize(Format format) {
+        return format == BC1 || format == BC4 ? 8 : 16;
+    }
+
+    size_t compressedSize(Format format, int width, int height) {
+        return size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+    }
+
+    std::vector<uint8_t> compress(const Mipmap::Level& level, Format format) {
+        return compressBlocks(format, level.width, level.height, [&](int bx, int by, uint8_t* out) {
+            // blocks past the edge repeat the last row and column.
+            uint8_t texels[16][4];
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(bx * 4 + (i & 3), level.width - 1);
+                int y = std::min(by * 4 + (i >> 2), level.height - 1);
+                memcpy(texels[i], &level.pixels[(size_t(y) * level.width + x) * 4], 4);
+            }
+
+            switch (format) {
+            case BC1:
+                encodeBC1(texels, out);
+                break;
+            case BC3:
+                encodeBC4(texels, 3, out);
+                encodeBC1(texels, out + 8);
+                break;
+            case BC4:
+                encodeBC4(texels, 0, out);
+                break;
+            case BC5:
+                encodeBC4(texels, 0, out);
+                encodeBC4(texels, 1, out + 8);
+                break;
+            case BC7:
+                encodeBC7(texels, out);
+                break;
+            case BC6H:
+                break;
+            }
+        });
+    }
+
+    std::vector<uint8_t> compressHalf(const float* rgba, int width, int height) {
+        return compressBlocks(BC6H, width, height, [&](int bx, int by, uint8_t* out) {
+            float texels[16][4];
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(bx * 4 + (i & 3), width - 1);
+                int y = std::min(by * 4 + (i >> 2), height - 1);
+                memcpy(texels[i], &rgba[(size_t(y) * width + x) * 4], 16);
+            }
+            encodeBC6H(texels, out);
+        });
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "mipmap.h"
+
+/* Block compression encoders. Each 4x4 block of texels becomes one 8 or 16
+ * byte block that the GPU decodes on sampling. The encoders favour speed:
+ * endpoints come from the block's principal axis and only one mode is
+ * used where the format has several (BC7 mode 6, BC6H mode 11), which is
+ * enough for material maps and smooth environment lighting. */
+namespace BC {
+    enum Format : uint32_t {
+        BC1,  // RGB, 4 bpp
+        BC3,  // RGBA, 8 bpp
+        BC4,  // R, 4 bpp: scalar maps
+        BC5,  // RG, 8 bpp: normal maps, z is reconstructed in the shader
+        BC6H, // RGB half float, 8 bpp: environment maps
+        BC7,  // RGBA, 8 bpp: albedo
+    };
+
+    size_t blockSize(Format format);
+    size_t compressedSize(Format format, int width, int height);
+
+    /* RGBA8 texels for every format but BC6H. Block rows are split across threads. */
+    std::vector<uint8_t> compress(const Mipmap::Level& level, Format format);
+    /* RGBA float texels, alpha ignored, for BC6H. */
+    std::vector<uint8_t> compressHalf(const float* rgba, int width, int height);
+}
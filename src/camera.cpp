@@ -3,6 +3,8 @@
 
 Camera::Camera(GLFWwindow* window) : window(window) {
     glfwGetCursorPos(window, &lastX, &lastY);
+    unjitteredProjection = glm::mat4(1.0f);
+    view = glm::mat4(1.0f);
 }
 
 void Camera::update(float deltaTime)
@@ -62,8 +64,28 @@ void Camera::update(float deltaTime)
         position += glm::normalize(velocity) * speed * deltaTime;
     }
 
+    previousViewProjection = unjitteredProjection * view;
+
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
-    projection = glm::perspective(glm::radians(fov), (float)width/height, 0.1f, 1000.0f);
-    view       = glm::lookAt(position, position + direction, glm::vec3(0, 1, 0));
+    unjitteredProjection = glm::perspective(glm::radians(fov), (float)width/height, zNear, zFar);
+    view                 = glm::lookAt(position, position + direction, glm::vec3(0, 1, 0));
+
+    // shifts clip space x and y by jitter * w, i.e. NDC by jitter: column 2
+    // scales view z, and w = -z, hence the subtraction.
+    projection = unjitteredProjection;
+    projection[2][0] -= jitter.x;
+    projection[2][1] -= jitter.y;
+
+    // Gribb/Hartmann plane extraction: left, right, bottom, top, near, far.
+    glm::mat4 m = unjitteredProjection * view;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            glm::vec4 plane;
+            for (int k = 0; k < 4; k++) {
+                plane[k] = m[k][3] + (j == 0 ? m[k][i] : -m[k][i]);
+            }
+            frustum[i*2 + j] = plane / glm::length(glm::vec3(plane));
+        }
+    }
 }
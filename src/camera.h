@@ -7,13 +7,19 @@ class Camera
 {
 public:
     float fov = 60.0f;
+    float zNear = 0.1f;
+    float zFar = 1000.0f;
     float vertical = 0.0f;
     float horizontal = glm::pi<float>();
     float speed = 3.0f;
     float mouseSpeed = 0.002f;
     glm::vec3 position = glm::vec3(0.0f, 0.0f, 5.0f);
+    glm::vec2 jitter = glm::vec2(0.0f); // sub-pixel projection offset in NDC, applied by update()
     glm::mat4 projection;
+    glm::mat4 unjitteredProjection;
+    glm::mat4 previousViewProjection = glm::mat4(1.0f); // unjittered, as of the previous update()
     glm::mat4 view;
+    glm::vec4 frustum[6];
 
     GLFWwindow* window;
     double lastX = 0, lastY = 0;
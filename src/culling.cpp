@@ -0,0 +1,211 @@
+#include "culling.h"
+
+#include <thread>
+#include <limits>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULLING_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(CULLING_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+/* below this many objects per thread, waking workers costs more than it saves. */
+constexpr size_t minObjectsPerThread = 16384;
+
+struct Bounds {
+    const float* min[3];
+    const float* max[3];
+};
+
+static bool hasAVX2()
+{
+#if defined(CULLING_X86) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("avx2");
+#elif defined(CULLING_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+static void cullScalar(const Bounds& b, const glm::vec4 planes[6], size_t begin, size_t end, std::vector<uint32_t>& out)
+{
+    for (size_t i = begin; i < end; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++) {
+            const glm::vec4& n = planes[p];
+            // p-vertex: the AABB corner furthest along the plane normal.
+            float px = n.x > 0 ? b.max[0][i] : b.min[0][i];
+            float py = n.y > 0 ? b.max[1][i] : b.min[1][i];
+            float pz = n.z > 0 ? b.max[2][i] : b.min[2][i];
+            float e = n.x * px + n.y * py + n.z * pz + n.w;
+            inside = e >= 0;
+        }
+        if (inside) {
+            out.push_back((uint32_t)i);
+        }
+    }
+}
+
+#ifdef CULLING_X86
+TARGET_AVX2 static void cullAVX2(const Bounds& b, const glm::vec4 planes[6], size_t begin, size_t end, std::vector<uint32_t>& out)
+{
+    __m256 nx[6], ny[6], nz[6], nw[6];
+    int px[6], py[6], pz[6];
+    for (int p = 0; p < 6; p++) {
+        nx[p] = _mm256_set1_ps(planes[p].x);
+        ny[p] = _mm256_set1_ps(planes[p].y);
+        nz[p] = _mm256_set1_ps(planes[p].z);
+        nw[p] = _mm256_set1_ps(planes[p].w);
+        // the normal is uniform across lanes, so is the choice of p-vertex.
+        px[p] = planes[p].x > 0;
+        py[p] = planes[p].y > 0;
+        pz[p] = planes[p].z > 0;
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    const float* const* corner[2] = { b.min, b.max };
+
+    // begin is always a multiple of 8 and the arrays are padded to a multiple of 8.
+    for (size_t i = begin; i < end; i += 8) {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m256 e = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(nx[p], _mm256_loadu_ps(corner[px[p]][0] + i)),
+                _mm256_mul_ps(ny[p], _mm256_loadu_ps(corner[py[p]][1] + i))),
+                _mm256_add_ps(_mm256_mul_ps(nz[p], _mm256_loadu_ps(corner[pz[p]][2] + i)), nw[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(e, zero, _CMP_GE_OQ));
+        }
+
+        unsigned mask = (unsigned)_mm256_movemask_ps(inside);
+        if (end - i < 8) {
+            mask &= (1u << (end - i)) - 1;
+        }
+        while (mask) {
+            unsigned lane = 0;
+            while (!(mask & (1u << lane))) lane++;
+            out.push_back((uint32_t)(i + lane));
+            mask &= mask - 1;
+        }
+    }
+}
+#endif
+
+Culling::Culling()
+    : count(0)
+    , threads(std::max(1u, std::thread::hardware_concurrency()))
+{ }
+
+void Culling::resize(size_t size)
+{
+    // keep every array a multiple of 8 long so that the last block can be loaded whole.
+    size_t padded = (size + 7) & ~size_t(7);
+    for (std::vector<float>* v : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+        v->resize(padded, 0.0f);
+    }
+}
+
+uint32_t Culling::add(const glm::vec3& min, const glm::vec3& max, const glm::mat4& model)
+{
+    uint32_t index = (uint32_t)count++;
+    resize(count);
+    set(index, min, max, model);
+    return index;
+}
+
+void Culling::set(uint32_t index, const glm::vec3& min, const glm::vec3& max, const glm::mat4& model)
+{
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner(
+            (i & 1) ? max.x : min.x,
+            (i & 2) ? max.y : min.y,
+            (i & 4) ? max.z : min.z);
+        glm::vec3 p = glm::vec3(model * glm::vec4(corner, 1.0f));
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+
+    minX[index] = lo.x;
+    minY[index] = lo.y;
+    minZ[index] = lo.z;
+    maxX[index] = hi.x;
+    maxY[index] = hi.y;
+    maxZ[index] = hi.z;
+}
+
+void Culling::clear()
+{
+    count = 0;
+    resize(0);
+    visible.clear();
+}
+
+const std::vector<uint32_t>& Culling::cull(const glm::vec4 planes[6])
+{
+    visible.clear();
+
+    size_t workers = std::min<size_t>(threads, std::max<size_t>(1, count / minObjectsPerThread));
+    if (workers <= 1) {
+        cullRange(planes, 0, count, visible);
+        return visible;
+    }
+
+    size_t chunk = ((count + workers - 1) / workers + 7) & ~size_t(7);
+    if (partial.size() < workers) {
+        partial.resize(workers);
+    }
+    // chunk 0 goes straight into visible, the others into their partial list.
+    pool.run(workers, [&](size_t w) {
+        size_t begin = std::min(count, w * chunk);
+        size_t end = std::min(count, begin + chunk);
+        if (w == 0) {
+            cullRange(planes, begin, end, visible);
+            return;
+        }
+        partial[w].clear();
+        cullRange(planes, begin, end, partial[w]);
+    });
+    for (size_t w = 1; w < workers; w++) {
+        visible.insert(visible.end(), partial[w].begin(), partial[w].end());
+    }
+
+    return visible;
+}
+
+void Culling::cullRange(const glm::vec4 planes[6], size_t begin, size_t end, std::vector<uint32_t>& out)
+{
+    if (begin >= end)
+        return;
+
+    Bounds b = {
+        { minX.data(), minY.data(), minZ.data() },
+        { maxX.data(), maxY.data(), maxZ.data() },
+    };
+
+#ifdef CULLING_X86
+    static const bool avx2 = hasAVX2();
+    if (avx2) {
+        cullAVX2(b, planes, begin, end, out);
+        return;
+    }
+#endif
+    cullScalar(b, planes, begin, end, out);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "workerpool.h"
+
+/* World-space AABBs are kept as structure-of-arrays so that the frustum
+ * test can run over 8 objects at a time with AVX2. Large sets are split
+ * over a WorkerPool that lives as long as the Culling. */
+class Culling {
+public:
+    Culling();
+
+    uint32_t add(const glm::vec3& min, const glm::vec3& max, const glm::mat4& model = glm::mat4(1.0f));
+    void set(uint32_t index, const glm::vec3& min, const glm::vec3& max, const glm::mat4& model = glm::mat4(1.0f));
+    void clear();
+
+    void setThreads(unsigned threads) { this->threads = threads ? threads : 1; }
+    size_t getCount() { return count; }
+
+    /* returns the indices of visible objects, in ascending order, e.g. for a Camera's frustum. */
+    const std::vector<uint32_t>& cull(const glm::vec4 planes[6]);
+    const std::vector<uint32_t>& getVisible() { return visible; }
+
+private:
+    void resize(size_t size);
+    void cullRange(const glm::vec4 planes[6], size_t begin, size_t end, std::vector<uint32_t>& out);
+
+private:
+    size_t count;
+    unsigned threads;
+
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    std::vector<std::vector<uint32_t>> partial;
+    std::vector<uint32_t> visible;
+    WorkerPool pool;
+};
@@ -0,0 +1,56 @@
+#include "dds.h"
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace DDS {
+    size_t blockSize(Format format) {
+        switch (format) {
+        case BC1: case BC1_SRGB: case BC4:
+            return 8;
+        case BC3: case BC3_SRGB: case BC5: case BC6H: case BC7: case BC7_SRGB:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    size_t Image::levelSize(int level) const {
+        int w = std::max(1, width >> level);
+        int h = std::max(1, height >> level);
+        return size_t((w + 3) / 4) * ((h + 3) / 4) * blockSize(format);
+    }
+
+    void write(const char* path, const Image& image) {
+        Header header = {};
+        header.size = sizeof(Header);
+        header.flags = flagsRequired | flagMipMapCount | flagLinearSize;
+        header.height = image.height;
+        header.width = image.width;
+        header.pitchOrLinearSize = (uint32_t)image.levelSize(0);
+        header.mipMapCount = image.levels;
+        header.pixelFormat.size = sizeof(PixelFormat);
+        header.pixelFormat.flags = pixelFormatFourCC;
+        header.pixelFormat.fourCC = fourCC('D', 'X', '1', '0');
+        header.caps[0] = capsTexture | (image.levels > 1 ? capsComplex | capsMipMap : 0);
+        if (image.faces == 6) {
+            header.caps[0] |= capsComplex;
+            header.caps[1] = caps2CubeMap | caps2AllFaces;
+        }
+
+        HeaderDX10 dx10 = {};
+        dx10.format = image.format;
+        dx10.dimension = dimensionTexture2D;
+        dx10.miscFlag = image.faces == 6 ? miscTextureCube : 0;
+        dx10.arraySize = 1;
+
+        std::ofstream file(path, std::ios::binary);
+        file.write((const char*)&magic, sizeof(magic));
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)&dx10, sizeof(dx10));
+        file.write((const char*)image.data.data(), image.data.size());
+        if (!file)
+            throw std::runtime_error(path);
+    }
+}
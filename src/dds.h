@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/* DDS container: the on-disk headers, shared with the TextureFile reader,
+ * and a writer for block-compressed images, which always writes the DX10
+ * header extension. Rows are stored bottom-up, the order glTexImage2D
+ * takes them in, which is how both the runtime and the offline encoder
+ * produce them. */
+namespace DDS {
+    /* the DXGI_FORMAT values of the formats we write. */
+    enum Format : uint32_t {
+        Unknown = 0,
+        BC1 = 71,
+        BC1_SRGB = 72,
+        BC3 = 77,
+        BC3_SRGB = 78,
+        BC4 = 80,
+        BC5 = 83,
+        BC6H = 95, // unsigned half float
+        BC7 = 98,
+        BC7_SRGB = 99,
+    };
+
+    constexpr uint32_t fourCC(char a, char b, char c, char d) {
+        return uint32_t(a) | uint32_t(b) << 8 | uint32_t(c) << 16 | uint32_t(d) << 24;
+    }
+
+    constexpr uint32_t magic = fourCC('D', 'D', 'S', ' ');
+
+    struct PixelFormat {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t bitCount;
+        uint32_t masks[4];
+    };
+
+    struct Header {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        PixelFormat pixelFormat;
+        uint32_t caps[4];
+        uint32_t reserved2;
+    };
+
+    struct HeaderDX10 {
+        uint32_t format;
+        uint32_t dimension;
+        uint32_t miscFlag;
+        uint32_t arraySize;
+        uint32_t miscFlags2;
+    };
+
+    static_assert(sizeof(Header) == 124, "DDS_HEADER is 124 bytes");
+    static_assert(sizeof(HeaderDX10) == 20, "DDS_HEADER_DXT10 is 20 bytes");
+
+    constexpr uint32_t flagsRequired = 0x1 | 0x2 | 0x4 | 0x1000; // CAPS, HEIGHT, WIDTH, PIXELFORMAT
+    constexpr uint32_t flagMipMapCount = 0x20000;
+    constexpr uint32_t flagLinearSize = 0x80000;
+    constexpr uint32_t pixelFormatFourCC = 0x4;
+    constexpr uint32_t pixelFormatRGB = 0x40;
+    constexpr uint32_t pixelFormatLuminance = 0x20000;
+    constexpr uint32_t capsComplex = 0x8;
+    constexpr uint32_t capsTexture = 0x1000;
+    constexpr uint32_t capsMipMap = 0x400000;
+    constexpr uint32_t caps2CubeMap = 0x200;
+    constexpr uint32_t caps2AllFaces = 0xFC00;
+    constexpr uint32_t caps2Volume = 0x200000;
+    constexpr uint32_t dimensionTexture1D = 2;
+    constexpr uint32_t dimensionTexture2D = 3;
+    constexpr uint32_t miscTextureCube = 0x4;
+
+    /* an image in memory, to be written. */
+    struct Image {
+        Format format = Unknown;
+        int width = 0;
+        int height = 0;
+        int levels = 1;
+        int faces = 1; // 6 for a cube map
+        std::vector<uint8_t> data; // every level of face 0, then of face 1, ...
+
+        size_t levelSize(int level) const;
+    };
+
+    size_t blockSize(Format format);
+
+    /* throws std::runtime_error if the file cannot be written. */
+    void write(const char* path, const Image& image);
+}
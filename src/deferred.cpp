@@ -0,0 +1,184 @@
+#include "deferred.h"
+#include "camera.h"
+#include "mesh.h"
+#include "pbr.h"
+#include "skybox.h"
+#include "shaders.h"
+#include "materialatlas.h"
+
+GLuint DeferredRenderPass::vao;
+DeferredRenderPass::GeometryProgram DeferredRenderPass::geometryprogs[Shaders::MaterialVariantCount];
+ShaderProgram DeferredRenderPass::lightingprog;
+ShaderProgram::Uniform DeferredRenderPass::invViewProj_Location;
+ShaderProgram::Uniform DeferredRenderPass::viewPos_Location;
+ClusteredLights::Locations DeferredRenderPass::lights_Locations;
+
+DeferredRenderPass::DeferredRenderPass() : lights(nullptr), impostors(false) {
+    if (vao == 0) {
+        glGenVertexArrays(1, &vao);
+
+        linkProgramAsync(&lightingprog,
+            Shaders::fullscreenVertexShader(),
+            Shaders::deferredFragmentShader(),
+            [] {
+                lightingprog.use();
+                lightingprog.set(lightingprog.uniform("gAlbedo"), 0);
+                lightingprog.set(lightingprog.uniform("gNormal"), 1);
+                lightingprog.set(lightingprog.uniform("gMaterial"), 2);
+                lightingprog.set(lightingprog.uniform("gDepth"), 3);
+                lightingprog.set(lightingprog.uniform("irradianceMap"), 4);
+                lightingprog.set(lightingprog.uniform("prefilterMap"), 5);
+                lightingprog.set(lightingprog.uniform("brdflutMap"), 6);
+                invViewProj_Location = lightingprog.uniform("invViewProj");
+                viewPos_Location = lightingprog.uniform("viewPos");
+                lights_Locations = ClusteredLights::locate(lightingprog);
+            });
+    }
+}
+
+void DeferredRenderPass::drawVAO(Camera* camera, int vao, int count, const glm::mat4& model, PBRMaterial* material) {
+    useMaterial(camera, model, material, false);
+    glBindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0);
+}
+
+void DeferredRenderPass::drawMesh(Camera* camera, Mesh* mesh, const DrawRanges& ranges, const glm::mat4& model, PBRMaterial* material) {
+    useMaterial(camera, model, material, true);
+    mesh->draw(ranges);
+}
+
+void DeferredRenderPass::drawSphere(Camera* camera, const glm::mat4& model, PBRMaterial* material) {
+    useMaterial(camera, model, material, true);
+    renderSphere();
+}
+
+void DeferredRenderPass::drawMeshInstanced(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count, MaterialAtlas* atlas, int batch) {
+    useInstanced(camera, MaterialAtlas::variant);
+    atlas->bind(batch);
+    drawInstances(mesh->getVAO(), mesh->getLod(lod).count, mesh->getLod(lod).first, instances, count);
+}
+
+void DeferredRenderPass::drawSphereInstanced(Camera* camera, const Instance* instances, GLsizei count, MaterialAtlas* atlas, int batch) {
+    useInstanced(camera, sphereVariant(MaterialAtlas::variant));
+    atlas->bind(batch);
+    drawSpheres(instances, count);
+}
+
+void DeferredRenderPass::drawMeshParametric(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count) {
+    useInstanced(camera, Shaders::ParametricMaterial);
+    drawInstances(mesh->getVAO(), mesh->getLod(lod).count, mesh->getLod(lod).first, instances, count);
+}
+
+void DeferredRenderPass::drawSphereParametric(Camera* camera, const Instance* instances, GLsizei count) {
+    useInstanced(camera, sphereVariant(Shaders::ParametricMaterial));
+    drawSpheres(instances, count);
+}
+
+unsigned DeferredRenderPass::sphereVariant(unsigned variant) {
+    return impostors ? variant | Shaders::SphereImpostor : variant;
+}
+
+void DeferredRenderPass::drawSpheres(const Instance* instances, GLsizei count) {
+    if (impostors) {
+        renderSphereImpostors(instances, count);
+    } else {
+        renderSphere(instances, count);
+    }
+}
+
+void DeferredRenderPass::drawLighting(Camera* camera, SkyboxMaterial* skybox, GLuint albedo, GLuint normal, GLuint material, GLuint depth) {
+    finishProgram(&lightingprog);
+    lightingprog.use();
+    lightingprog.set(invViewProj_Location, glm::inverse(camera->projection * camera->view));
+    lightingprog.set(viewPos_Location, camera->position);
+    lights->bind(lightingprog, lights_Locations);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, albedo);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, normal);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, material);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox->getIrradianceMap());
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox->getPrefilterMap());
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, skybox->getBRDFLUTMap());
+
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void DeferredRenderPass::prepare(PBRMaterial* material, bool vertexTangents) {
+    prepareVariant(material->getVariant(vertexTangents));
+}
+
+void DeferredRenderPass::prepareAtlas() {
+    prepareVariant(MaterialAtlas::variant);
+    prepareVariant(MaterialAtlas::variant | Shaders::SphereImpostor);
+}
+
+void DeferredRenderPass::prepareParametric() {
+    prepareVariant(Shaders::ParametricMaterial);
+    prepareVariant(Shaders::ParametricMaterial | Shaders::SphereImpostor);
+}
+
+void DeferredRenderPass::prepareVariant(unsigned variant) {
+    GeometryProgram& p = geometryprogs[variant];
+    if (p.program.getId() != 0)
+        return;
+
+    GLuint vs = Shaders::pbrVertexShader();
+    if (variant & Shaders::SphereImpostor)
+        vs = Shaders::sphereImpostorVertexShader();
+    else if (variant & Shaders::InstancedVariants)
+        vs = Shaders::pbrInstancedVertexShader();
+
+    linkProgramAsync(&p.program, vs,
+        Shaders::gbufferFragmentShader(variant),
+        [&p] {
+            ShaderProgram& program = p.program;
+            program.use();
+            program.set(program.uniform("albedoMap"), 0);
+            program.set(program.uniform("normalMap"), 1);
+            program.set(program.uniform("metallicMap"), 2);
+            program.set(program.uniform("roughnessMap"), 3);
+            program.set(program.uniform("ormMap"), 2);
+            program.set(program.uniform("materialData"), 3);
+            p.MVP_Location = program.uniform("MVP");
+            p.viewProj_Location = program.uniform("uViewProj");
+            p.eye_Location = program.uniform("uEye");
+            p.uModel_Location = program.uniform("uModel");
+            p.albedo_Location = program.uniform("albedoConstant");
+            p.metallic_Location = program.uniform("metallicConstant");
+            p.roughness_Location = program.uniform("roughnessConstant");
+        });
+}
+
+/* links the variant on first use unless prepare already did. */
+DeferredRenderPass::GeometryProgram& DeferredRenderPass::useGeometryProgram(unsigned variant) {
+    prepareVariant(variant);
+    GeometryProgram& p = geometryprogs[variant];
+    finishProgram(&p.program);
+    p.program.use();
+    return p;
+}
+
+void DeferredRenderPass::useMaterial(Camera* camera, const glm::mat4& model, PBRMaterial* material, bool vertexTangents) {
+    GeometryProgram& p = useGeometryProgram(material->getVariant(vertexTangents));
+    p.program.set(p.MVP_Location, camera->projection * camera->view * model);
+    p.program.set(p.uModel_Location, model);
+    p.program.set(p.albedo_Location, material->getAlbedo());
+    p.program.set(p.metallic_Location, material->getMetallic());
+    p.program.set(p.roughness_Location, material->getRoughness());
+    material->bind();
+}
+
+void DeferredRenderPass::useInstanced(Camera* camera, unsigned variant) {
+    GeometryProgram& p = useGeometryProgram(variant);
+    p.program.set(p.viewProj_Location, camera->projection * camera->view);
+    p.program.set(p.eye_Location, camera->position);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+#include "renderpass.h"
+#include "lights.h"
+#include "shaders.h"
+
+class Camera;
+class Mesh;
+struct DrawRanges;
+class PBRMaterial;
+class SkyboxMaterial;
+class MaterialAtlas;
+
+/* Deferred alternative to PBRRenderPass. The geometry pass writes a G-buffer
+ * (sRGB albedo with occlusion in alpha, octahedral normal in RG16,
+ * metallic/roughness in RG8 and depth); the lighting pass then runs the
+ * same GGX/split-sum shading once per pixel from a full-screen triangle. */
+class DeferredRenderPass : public RenderPass {
+public:
+    static constexpr GLenum albedoFormat = GL_SRGB8_ALPHA8;
+    static constexpr GLenum normalFormat = GL_RG16;
+    static constexpr GLenum materialFormat = GL_RG8;
+    static constexpr GLenum depthFormat = GL_DEPTH_COMPONENT24;
+
+    DeferredRenderPass();
+    void drawVAO(Camera* camera, int vao, int count, const glm::mat4& model, PBRMaterial* material);
+    void drawMesh(Camera* camera, Mesh* mesh, const DrawRanges& ranges, const glm::mat4& model, PBRMaterial* material);
+    void drawSphere(Camera* camera, const glm::mat4& model, PBRMaterial* material);
+    /* see PBRRenderPass::drawMeshInstanced. */
+    void drawMeshInstanced(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count, MaterialAtlas* atlas, int batch);
+    void drawSphereInstanced(Camera* camera, const Instance* instances, GLsizei count, MaterialAtlas* atlas, int batch);
+    /* see PBRRenderPass::drawMeshParametric. */
+    void drawMeshParametric(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count);
+    void drawSphereParametric(Camera* camera, const Instance* instances, GLsizei count);
+    void drawLighting(Camera* camera, SkyboxMaterial* skybox, GLuint albedo, GLuint normal, GLuint material, GLuint depth);
+
+    void setLights(ClusteredLights* lights) { this->lights = lights; }
+    /* see PBRRenderPass::setSphereImpostors. */
+    void setSphereImpostors(bool impostors) { this->impostors = impostors; }
+
+    /* starts compiling the material's G-buffer variant in the background. */
+    void prepare(PBRMaterial* material, bool vertexTangents = true);
+    void prepareAtlas();
+    void prepareParametric();
+
+private:
+    struct GeometryProgram {
+        ShaderProgram program;
+        ShaderProgram::Uniform MVP_Location;
+        ShaderProgram::Uniform viewProj_Location;
+        ShaderProgram::Uniform eye_Location;
+        ShaderProgram::Uniform uModel_Location;
+        ShaderProgram::Uniform albedo_Location;
+        ShaderProgram::Uniform metallic_Location;
+        ShaderProgram::Uniform roughness_Location;
+    };
+
+    void prepareVariant(unsigned variant);
+    GeometryProgram& useGeometryProgram(unsigned variant);
+    void useMaterial(Camera* camera, const glm::mat4& model, PBRMaterial* material, bool vertexTangents);
+    void useInstanced(Camera* camera, unsigned variant);
+    unsigned sphereVariant(unsigned variant);
+    void drawSpheres(const Instance* instances, GLsizei count);
+
+private:
+    ClusteredLights* lights;
+    bool impostors;
+
+    static GLuint vao;
+    static GeometryProgram geometryprogs[Shaders::MaterialVariantCount];
+    static ShaderProgram lightingprog;
+    static ShaderProgram::Uniform invViewProj_Location;
+    static ShaderProgram::Uniform viewPos_Location;
+    static ClusteredLights::Locations lights_Locations;
+};
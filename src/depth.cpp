@@ -0,0 +1,87 @@
+#include "depth.h"
+#include "camera.h"
+#include "mesh.h"
+#include "shaders.h"
+
+ShaderProgram DepthRenderPass::program;
+ShaderProgram::Uniform DepthRenderPass::MVP_Location;
+ShaderProgram DepthRenderPass::instancedprog;
+ShaderProgram::Uniform DepthRenderPass::viewProj_Location;
+ShaderProgram DepthRenderPass::impostorprog;
+ShaderProgram::Uniform DepthRenderPass::impostorViewProj_Location;
+ShaderProgram::Uniform DepthRenderPass::impostorEye_Location;
+
+DepthRenderPass::DepthRenderPass() : impostors(false) {
+    if (program.getId() == 0) {
+        linkProgramAsync(&program,
+            Shaders::depthVertexShader(),
+            Shaders::depthFragmentShader(),
+            [] {
+                MVP_Location = program.uniform("MVP");
+            });
+        linkProgramAsync(&instancedprog,
+            Shaders::depthInstancedVertexShader(),
+            Shaders::depthFragmentShader(),
+            [] {
+                viewProj_Location = instancedprog.uniform("uViewProj");
+            });
+        linkProgramAsync(&impostorprog,
+            Shaders::sphereImpostorVertexShader(),
+            Shaders::depthImpostorFragmentShader(),
+            [] {
+                impostorViewProj_Location = impostorprog.uniform("uViewProj");
+                impostorEye_Location = impostorprog.uniform("uEye");
+            });
+    }
+}
+
+void DepthRenderPass::drawVAO(Camera* camera, int vao, int count, const glm::mat4& model) {
+    finishProgram(&program);
+    program.use();
+    setupMatrix(camera, model);
+    glBindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0);
+}
+
+void DepthRenderPass::drawMesh(Camera* camera, Mesh* mesh, const DrawRanges& ranges, const glm::mat4& model) {
+    finishProgram(&program);
+    program.use();
+    setupMatrix(camera, model);
+    mesh->draw(ranges);
+}
+
+void DepthRenderPass::drawSphere(Camera* camera, const glm::mat4& model) {
+    finishProgram(&program);
+    program.use();
+    setupMatrix(camera, model);
+    renderSphere();
+}
+
+void DepthRenderPass::drawMeshInstanced(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count) {
+    useInstanced(camera);
+    drawInstances(mesh->getVAO(), mesh->getLod(lod).count, mesh->getLod(lod).first, instances, count);
+}
+
+void DepthRenderPass::drawSphereInstanced(Camera* camera, const Instance* instances, GLsizei count) {
+    if (impostors) {
+        finishProgram(&impostorprog);
+        impostorprog.use();
+        impostorprog.set(impostorViewProj_Location, camera->projection * camera->view);
+        impostorprog.set(impostorEye_Location, camera->position);
+        renderSphereImpostors(instances, count);
+        return;
+    }
+    useInstanced(camera);
+    renderSphere(instances, count);
+}
+
+void DepthRenderPass::useInstanced(Camera* camera) {
+    finishProgram(&instancedprog);
+    instancedprog.use();
+    instancedprog.set(viewProj_Location, camera->projection * camera->view);
+}
+
+void DepthRenderPass::setupMatrix(Camera* camera, const glm::mat4& model) {
+    glm::mat4 MVP = camera->projection * camera->view * model;
+    program.set(MVP_Location, MVP);
+}
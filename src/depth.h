@@ -0,0 +1,40 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+#include "renderpass.h"
+
+class Camera;
+class Mesh;
+struct DrawRanges;
+
+/* Depth-only pre-pass. Run with color writes disabled, after which the
+ * depth buffer holds the nearest opaque surface and the shading pass can
+ * run with GL_LEQUAL and depth writes off (see PassScheduler). */
+class DepthRenderPass : public RenderPass {
+public:
+    DepthRenderPass();
+    void drawVAO(Camera* camera, int vao, int count, const glm::mat4& model);
+    void drawMesh(Camera* camera, Mesh* mesh, const DrawRanges& ranges, const glm::mat4& model);
+    void drawSphere(Camera* camera, const glm::mat4& model);
+    /* with the same transform as the instanced shading variants. */
+    void drawMeshInstanced(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count);
+    void drawSphereInstanced(Camera* camera, const Instance* instances, GLsizei count);
+
+    /* see PBRRenderPass::setSphereImpostors; must match the shading pass. */
+    void setSphereImpostors(bool impostors) { this->impostors = impostors; }
+
+private:
+    void setupMatrix(Camera* camera, const glm::mat4& model);
+    void useInstanced(Camera* camera);
+
+private:
+    bool impostors;
+
+    static ShaderProgram program;
+    static ShaderProgram::Uniform MVP_Location;
+    static ShaderProgram instancedprog;
+    static ShaderProgram::Uniform viewProj_Location;
+    static ShaderProgram impostorprog;
+    static ShaderProgram::Uniform impostorViewProj_Location;
+    static ShaderProgram::Uniform impostorEye_Location;
+};
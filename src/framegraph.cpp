@@ -0,0 +1,457 @@
+#include "framegraph.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+/* pooled textures and framebuffers unused for this many frames are deleted. */
+constexpr int maxIdleFrames = 120;
+
+FrameGraph::Resource FrameGraph::Builder::create(const char* name, const TextureDesc& desc) {
+    return graph->addResource(name, desc, false);
+}
+
+FrameGraph::Resource FrameGraph::Builder::get(const char* name) {
+    for (size_t i = 0; i < graph->resources.size(); i++) {
+        if (strcmp(graph->resources[i].name, name) == 0)
+            return (Resource)i;
+    }
+    throw std::runtime_error(std::string("FrameGraph: no resource named ") + name);
+}
+
+FrameGraph::Resource FrameGraph::Builder::read(Resource resource, bool resolve) {
+    ResourceNode& node = graph->resources[resource];
+    if (resolve && node.desc.samples > 1 && node.resolve < 0) {
+        TextureDesc desc = node.desc;
+        desc.samples = 1;
+        Resource resolve = graph->addResource(node.name, desc, false);
+        graph->resources[resource].resolve = resolve;
+    }
+
+    Pass* p = graph->passes[pass];
+    p->reads.push_back(resource);
+    if (resolve && graph->resources[resource].resolve >= 0) {
+        p->reads.push_back(graph->resources[resource].resolve);
+    }
+    return resource;
+}
+
+FrameGraph::Resource FrameGraph::Builder::write(Resource resource, bool clear) {
+    Pass* p = graph->passes[pass];
+    if (graph->resources[resource].writers++ > 0)
+        p->loads.push_back(resource);
+    p->writes.push_back(resource);
+    p->clears.push_back(clear);
+    return resource;
+}
+
+FrameGraph::FrameGraph()
+    : frame(0)
+    , clearColor{ 0, 0, 0, 1 }
+{
+    glGenFramebuffers(2, resolveFramebuffers);
+}
+
+FrameGraph::~FrameGraph() {
+    for (auto& entry : framebufferPool) {
+        glDeleteFramebuffers(1, &entry.fbo);
+    }
+    for (auto& entry : texturePool) {
+        glDeleteTextures(1, &entry.texture);
+    }
+    glDeleteFramebuffers(2, resolveFramebuffers);
+}
+
+void FrameGraph::beginFrame() {
+    frame++;
+    passes.clear();
+    resources.clear();
+}
+
+FrameGraph::Resource FrameGraph::importBackbuffer(const char* name, int width, int height) {
+    TextureDesc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.format = GL_NONE;
+    return addResource(name, desc, true);
+}
+
+FrameGraph::Resource FrameGraph::importTexture(const char* name, GLuint texture, const TextureDesc& desc) {
+    Resource resource = addResource(name, desc, true);
+    resources[resource].texture = texture;
+    return resource;
+}
+
+FrameGraph::Resource FrameGraph::create(const char* name, const TextureDesc& desc) {
+    return addResource(name, desc, false);
+}
+
+void FrameGraph::addPass(Pass* pass) {
+    pass->reads.clear();
+    pass->writes.clear();
+    pass->loads.clear();
+    pass->clears.clear();
+    passes.push_back(pass);
+
+    Builder builder(this, (int)passes.size() - 1);
+    pass->setup(builder);
+}
+
+void FrameGraph::setClearColor(float r, float g, float b, float a) {
+    clearColor[0] = r;
+    clearColor[1] = g;
+    clearColor[2] = b;
+    clearColor[3] = a;
+}
+
+GLuint FrameGraph::getTexture(Resource resource, bool resolve) {
+    const ResourceNode& node = resources[resource];
+    return resolve && node.resolve >= 0 ? resources[node.resolve].texture : node.texture;
+}
+
+FrameGraph::Resource FrameGraph::addResource(const char* name, const TextureDesc& desc, bool imported) {
+    ResourceNode node;
+    node.name = name;
+    node.desc = desc;
+    node.imported = imported;
+    node.refs = 0;
+    node.firstUse = -1;
+    node.lastUse = -1;
+    node.texture = 0;
+    node.resolve = -1;
+    node.writers = 0;
+    node.written = false;
+    node.resolved = false;
+    resources.push_back(node);
+    return (Resource)resources.size() - 1;
+}
+
+void FrameGraph::compile() {
+    // cull passes that do not contribute to an imported resource.
+    for (Pass* pass : passes) {
+        pass->refs = (int)pass->writes.size();
+        pass->culled = pass->writes.empty();
+    }
+    for (Pass* pass : passes) {
+        if (pass->culled)
+            continue;
+        for (auto* list : { &pass->reads, &pass->loads }) {
+            for (Resource r : *list) {
+                resources[r].refs++;
+            }
+        }
+    }
+
+    stack.clear();
+    for (size_t r = 0; r < resources.size(); r++) {
+        if (resources[r].refs == 0 && !resources[r].imported)
+            stack.push_back((Resource)r);
+    }
+    while (!stack.empty()) {
+        Resource r = stack.back();
+        stack.pop_back();
+        for (Pass* pass : passes) {
+            if (pass->culled)
+                continue;
+            for (Resource w : pass->writes) {
+                if (w != r || --pass->refs > 0)
+                    continue;
+                pass->culled = true;
+                for (auto* list : { &pass->reads, &pass->loads }) {
+                    for (Resource read : *list) {
+                        if (--resources[read].refs == 0 && !resources[read].imported)
+                            stack.push_back(read);
+                    }
+                }
+            }
+        }
+    }
+
+    // lifetimes over the surviving passes.
+    for (int i = 0; i < (int)passes.size(); i++) {
+        if (passes[i]->culled)
+            continue;
+        for (auto* list : { &passes[i]->reads, &passes[i]->writes }) {
+            for (Resource r : *list) {
+                ResourceNode& node = resources[r];
+                if (node.firstUse < 0)
+                    node.firstUse = i;
+                node.lastUse = i;
+            }
+        }
+    }
+
+    // assign pooled textures in pass order, returning each one to the pool
+    // after its last use so that later resources can alias it.
+    for (auto& entry : texturePool) {
+        entry.inUse = false;
+    }
+    for (int i = 0; i < (int)passes.size(); i++) {
+        for (ResourceNode& node : resources) {
+            if (node.firstUse == i && !node.imported)
+                node.texture = acquireTexture(node.desc);
+        }
+        for (ResourceNode& node : resources) {
+            if (node.lastUse == i && !node.imported)
+                releaseTexture(node.texture);
+        }
+    }
+}
+
+void FrameGraph::execute() {
+    for (Pass* pass : passes) {
+        if (pass->culled)
+            continue;
+
+        for (Resource r : pass->reads) {
+            if (resources[r].resolve >= 0)
+                resolve(r);
+        }
+
+        bindTargets(pass);
+        pass->execute();
+
+        for (Resource r : pass->writes) {
+            resources[r].written = true;
+            resources[r].resolved = false;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    collectGarbage();
+}
+
+void FrameGraph::bindTargets(Pass* pass) {
+    if (pass->writes.empty())
+        return;
+
+    bool backbuffer = false;
+    for (Resource r : pass->writes) {
+        backbuffer |= resources[r].imported && resources[r].texture == 0;
+    }
+
+    const TextureDesc& desc = resources[pass->writes[0]].desc;
+    glBindFramebuffer(GL_FRAMEBUFFER, backbuffer ? 0 : acquireFramebuffer(pass));
+    glViewport(0, 0, desc.width, desc.height);
+
+    // the first write of a frame clears, since pooled contents are undefined.
+    const GLint zero = 0;
+    int color = 0;
+    for (size_t i = 0; i < pass->writes.size(); i++) {
+        ResourceNode& node = resources[pass->writes[i]];
+        bool depth = isDepthFormat(node.desc.format);
+        bool clear = pass->clears[i] && !node.written;
+
+        if (clear && node.imported && node.texture == 0) {
+            glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        } else if (clear && depth) {
+            const GLfloat one = 1.0f;
+            glClearBufferfv(GL_DEPTH, 0, &one);
+            glClearBufferiv(GL_STENCIL, 0, &zero);
+        } else if (clear) {
+            glClearBufferfv(GL_COLOR, color, clearColor);
+        }
+
+        if (!depth)
+            color++;
+    }
+}
+
+GLuint FrameGraph::acquireFramebuffer(Pass* pass) {
+    GLuint attachments[5] = {};
+    int color = 0;
+    for (Resource r : pass->writes) {
+        const ResourceNode& node = resources[r];
+        if (isDepthFormat(node.desc.format)) {
+            attachments[4] = node.texture;
+        } else if (color < 4) {
+            attachments[color++] = node.texture;
+        }
+    }
+
+    for (auto& entry : framebufferPool) {
+        if (memcmp(entry.attachments, attachments, sizeof(attachments)) == 0) {
+            entry.lastFrame = frame;
+            return entry.fbo;
+        }
+    }
+
+    PooledFramebuffer entry;
+    memcpy(entry.attachments, attachments, sizeof(attachments));
+    entry.lastFrame = frame;
+    glGenFramebuffers(1, &entry.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, entry.fbo);
+
+    GLenum drawBuffers[4];
+    color = 0;
+    for (Resource r : pass->writes) {
+        const ResourceNode& node = resources[r];
+        GLenum target = node.desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+        if (isDepthFormat(node.desc.format)) {
+            bool stencil = node.desc.format == GL_DEPTH24_STENCIL8 || node.desc.format == GL_DEPTH32F_STENCIL8;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, target, node.texture, 0);
+        } else if (color < 4) {
+            drawBuffers[color] = GL_COLOR_ATTACHMENT0 + color;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[color], target, node.texture, 0);
+            color++;
+        }
+    }
+    if (color > 0) {
+        glDrawBuffers(color, drawBuffers);
+    } else {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error(std::string("FrameGraph: incomplete framebuffer in pass ") + pass->name);
+    }
+
+    framebufferPool.push_back(entry);
+    return entry.fbo;
+}
+
+GLuint FrameGraph::acquireTexture(const TextureDesc& desc) {
+    for (auto& entry : texturePool) {
+        if (!entry.inUse && entry.desc == desc) {
+            entry.inUse = true;
+            entry.lastFrame = frame;
+            return entry.texture;
+        }
+    }
+
+    PooledTexture entry;
+    entry.desc = desc;
+    entry.inUse = true;
+    entry.lastFrame = frame;
+    glGenTextures(1, &entry.texture);
+
+    if (desc.samples > 1) {
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, entry.texture);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.format, desc.width, desc.height, GL_TRUE);
+    } else {
+        GLenum format = GL_RGBA, type = GL_FLOAT, filter = GL_LINEAR;
+        switch (desc.format) {
+        case GL_DEPTH_COMPONENT16:
+        case GL_DEPTH_COMPONENT24:
+        case GL_DEPTH_COMPONENT32F:
+            format = GL_DEPTH_COMPONENT;
+            filter = GL_NEAREST;
+            break;
+        case GL_DEPTH24_STENCIL8:
+            format = GL_DEPTH_STENCIL;
+            type = GL_UNSIGNED_INT_24_8;
+            filter = GL_NEAREST;
+            break;
+        case GL_DEPTH32F_STENCIL8:
+            format = GL_DEPTH_STENCIL;
+            type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+            filter = GL_NEAREST;
+            break;
+        case GL_R32UI:
+        case GL_RG32UI:
+        case GL_RGBA32UI:
+            format = GL_RGBA_INTEGER;
+            type = GL_UNSIGNED_INT;
+            filter = GL_NEAREST;
+            break;
+        }
+        glBindTexture(GL_TEXTURE_2D, entry.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    texturePool.push_back(entry);
+    return entry.texture;
+}
+
+void FrameGraph::releaseTexture(GLuint texture) {
+    for (auto& entry : texturePool) {
+        if (entry.texture == texture) {
+            entry.inUse = false;
+            return;
+        }
+    }
+}
+
+void FrameGraph::resolve(Resource resource) {
+    ResourceNode& node = resources[resource];
+    if (node.resolved)
+        return;
+
+    bool depth = isDepthFormat(node.desc.format);
+    GLenum attachment = GL_COLOR_ATTACHMENT0;
+    if (depth) {
+        bool stencil = node.desc.format == GL_DEPTH24_STENCIL8 || node.desc.format == GL_DEPTH32F_STENCIL8;
+        attachment = stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFramebuffers[0]);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, attachment, GL_TEXTURE_2D_MULTISAMPLE, node.texture, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffers[1]);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, resources[node.resolve].texture, 0);
+
+    int w = node.desc.width, h = node.desc.height;
+    glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, depth ? GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // detach so the pooled textures are not kept referenced between frames.
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFramebuffers[0]);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, attachment, GL_TEXTURE_2D_MULTISAMPLE, 0, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    node.resolved = true;
+}
+
+void FrameGraph::collectGarbage() {
+    for (size_t i = 0; i < framebufferPool.size(); ) {
+        if (frame - framebufferPool[i].lastFrame > maxIdleFrames) {
+            glDeleteFramebuffers(1, &framebufferPool[i].fbo);
+            framebufferPool[i] = framebufferPool.back();
+            framebufferPool.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    for (size_t i = 0; i < texturePool.size(); ) {
+        if (frame - texturePool[i].lastFrame <= maxIdleFrames) {
+            i++;
+            continue;
+        }
+
+        // a framebuffer still pointing at this texture would match a recycled name.
+        GLuint texture = texturePool[i].texture;
+        for (size_t j = 0; j < framebufferPool.size(); ) {
+            GLuint* a = framebufferPool[j].attachments;
+            if (std::find(a, a + 5, texture) != a + 5) {
+                glDeleteFramebuffers(1, &framebufferPool[j].fbo);
+                framebufferPool[j] = framebufferPool.back();
+                framebufferPool.pop_back();
+            } else {
+                j++;
+            }
+        }
+
+        glDeleteTextures(1, &texture);
+        texturePool[i] = texturePool.back();
+        texturePool.pop_back();
+    }
+}
+
+bool FrameGraph::isDepthFormat(GLenum format) {
+    switch (format) {
+    case GL_DEPTH_COMPONENT16:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+    case GL_DEPTH32F_STENCIL8:
+        return true;
+    default:
+        return false;
+    }
+}
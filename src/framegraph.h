@@ -0,0 +1,129 @@
+#pragma once
+#include <glad.h>
+#include <vector>
+#include <functional>
+
+/* Passes declare, every frame, the targets they read and write. From that
+ * the graph culls passes whose output nobody reads, takes transient
+ * textures and framebuffers from a pool that persists across frames
+ * (letting textures with disjoint lifetimes alias), clears targets on
+ * their first write and resolves multisampled targets before they are
+ * read. Writing a resource an earlier pass already wrote draws over its
+ * contents, so it keeps that earlier pass alive. A pass that declares no
+ * writes is culled, which is how a pass opts out of a frame. Passes are
+ * owned by the caller and re-added every frame, so a steady-state frame
+ * allocates nothing. */
+class FrameGraph {
+public:
+    typedef int Resource;
+
+    struct TextureDesc {
+        int width = 0;
+        int height = 0;
+        GLenum format = GL_RGBA8;
+        int samples = 1;
+
+        bool operator==(const TextureDesc& o) const {
+            return width == o.width && height == o.height && format == o.format && samples == o.samples;
+        }
+    };
+
+    class Builder {
+    public:
+        Resource create(const char* name, const TextureDesc& desc);
+        Resource get(const char* name);
+        /* resolve = false samples a multisampled resource as is (sampler2DMS). */
+        Resource read(Resource resource, bool resolve = true);
+        Resource write(Resource resource, bool clear = true);
+
+    private:
+        friend class FrameGraph;
+        Builder(FrameGraph* graph, int pass) : graph(graph), pass(pass) { }
+        FrameGraph* graph;
+        int pass;
+    };
+
+    struct Pass {
+        const char* name = "";
+        std::function<void(Builder&)> setup;
+        std::function<void()> execute;
+
+    private:
+        friend class FrameGraph;
+        std::vector<Resource> reads;
+        std::vector<Resource> writes;
+        std::vector<Resource> loads;
+        std::vector<bool> clears;
+        int refs = 0;
+        bool culled = false;
+    };
+
+public:
+    FrameGraph();
+    ~FrameGraph();
+
+    void beginFrame();
+    Resource importBackbuffer(const char* name, int width, int height);
+    /* a texture owned by the caller that outlives the frame, e.g. a history buffer. */
+    Resource importTexture(const char* name, GLuint texture, const TextureDesc& desc);
+    Resource create(const char* name, const TextureDesc& desc);
+    void addPass(Pass* pass);
+    void compile();
+    void execute();
+
+    void setClearColor(float r, float g, float b, float a);
+
+    /* valid inside Pass::execute. multisampled resources return their resolve
+     * unless resolve is false. */
+    GLuint getTexture(Resource resource, bool resolve = true);
+    const TextureDesc& getDesc(Resource resource) { return resources[resource].desc; }
+    bool isCulled(Pass* pass) { return pass->culled; }
+
+private:
+    struct ResourceNode {
+        const char* name;
+        TextureDesc desc;
+        bool imported;
+        int refs;
+        int firstUse;
+        int lastUse;
+        GLuint texture;
+        Resource resolve;
+        int writers;
+        bool written;
+        bool resolved;
+    };
+
+    struct PooledTexture {
+        TextureDesc desc;
+        GLuint texture;
+        bool inUse;
+        int lastFrame;
+    };
+
+    struct PooledFramebuffer {
+        GLuint attachments[5];
+        GLuint fbo;
+        int lastFrame;
+    };
+
+    Resource addResource(const char* name, const TextureDesc& desc, bool imported);
+    GLuint acquireTexture(const TextureDesc& desc);
+    void releaseTexture(GLuint texture);
+    GLuint acquireFramebuffer(Pass* pass);
+    void bindTargets(Pass* pass);
+    void resolve(Resource resource);
+    void collectGarbage();
+
+    static bool isDepthFormat(GLenum format);
+
+private:
+    int frame;
+    float clearColor[4];
+    std::vector<Pass*> passes;
+    std::vector<ResourceNode> resources;
+    std::vector<PooledTexture> texturePool;
+    std::vector<PooledFramebuffer> framebufferPool;
+    std::vector<Resource> stack;
+    GLuint resolveFramebuffers[2];
+};
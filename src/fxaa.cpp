@@ -0,0 +1,27 @@
+#include "fxaa.h"
+#include "shaders.h"
+
+GLuint FXAARenderPass::vao;
+ShaderProgram FXAARenderPass::program;
+
+FXAARenderPass::FXAARenderPass() {
+    if (vao == 0) {
+        glGenVertexArrays(1, &vao);
+        linkProgramAsync(&program,
+            Shaders::fullscreenVertexShader(),
+            Shaders::fxaaFragmentShader(),
+            [] {
+                program.use();
+                program.set(program.uniform("ldr"), 0);
+            });
+    }
+}
+
+void FXAARenderPass::draw(GLuint ldr) {
+    finishProgram(&program);
+    program.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, ldr);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <glad.h>
+#include "renderpass.h"
+
+/* Post-process anti-aliasing on the tonemapped image, for when MSAA
+ * storage and bandwidth are too expensive. Reads an sRGB texture so that
+ * edges are found on perceptual luma. */
+class FXAARenderPass : public RenderPass {
+public:
+    FXAARenderPass();
+    void draw(GLuint ldr);
+
+private:
+    static GLuint vao;
+    static ShaderProgram program;
+};
@@ -0,0 +1,195 @@
+#include "lights.h"
+#include "camera.h"
+
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+/* below this many lights, binning on one thread is faster than waking workers. */
+constexpr size_t minLightsForThreads = 64;
+
+ClusteredLights::ClusteredLights()
+    : projection(0.0f)
+    , clusterLights(clusterCount * maxLightsPerCluster)
+    , grid(clusterCount * 2)
+    , view(1.0f)
+    , zNear(0.1f)
+    , zFar(1000.0f)
+    , width(1)
+    , height(1)
+{
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+}
+
+ClusteredLights::~ClusteredLights() {
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+}
+
+uint32_t ClusteredLights::add(const Light& light) {
+    lights.push_back(light);
+    return (uint32_t)lights.size() - 1;
+}
+
+void ClusteredLights::buildClusters() {
+    glm::mat4 invProjection = glm::inverse(projection);
+
+    for (int y = 0; y < tilesY; y++) {
+        for (int x = 0; x < tilesX; x++) {
+            // view-space rays through the tile corners, scaled to unit depth.
+            glm::vec3 rays[4];
+            for (int i = 0; i < 4; i++) {
+                float nx = -1.0f + 2.0f * (x + (i & 1)) / tilesX;
+                float ny = -1.0f + 2.0f * (y + (i >> 1)) / tilesY;
+                glm::vec4 p = invProjection * glm::vec4(nx, ny, -1.0f, 1.0f);
+                glm::vec3 v = glm::vec3(p) / p.w;
+                rays[i] = v / -v.z;
+            }
+
+            for (int k = 0; k < slices; k++) {
+                float dn = zNear * std::pow(zFar / zNear, (float)k / slices);
+                float df = zNear * std::pow(zFar / zNear, (float)(k + 1) / slices);
+
+                glm::vec3 lo(std::min(rays[0].x, rays[2].x) * (rays[0].x < 0 ? df : dn),
+                             std::min(rays[0].y, rays[1].y) * (rays[0].y < 0 ? df : dn), -df);
+                glm::vec3 hi(std::max(rays[1].x, rays[3].x) * (rays[1].x > 0 ? df : dn),
+                             std::max(rays[2].y, rays[3].y) * (rays[2].y > 0 ? df : dn), -dn);
+
+                int cluster = (k * tilesY + y) * tilesX + x;
+                clusterMin[cluster] = lo;
+                clusterMax[cluster] = hi;
+            }
+        }
+    }
+}
+
+void ClusteredLights::update(Camera* camera, int width, int height) {
+    this->width = width;
+    this->height = height;
+    view = camera->view;
+
+    // sub-pixel jitter would rebuild the clusters every frame for no gain.
+    if (projection != camera->unjitteredProjection || zNear != camera->zNear || zFar != camera->zFar) {
+        projection = camera->unjitteredProjection;
+        zNear = camera->zNear;
+        zFar = camera->zFar;
+        buildClusters();
+    }
+
+    // view-space bounds and slice range of every light.
+    float sliceScale = slices / std::log(zFar / zNear);
+    bounds.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); i++) {
+        Bounds& b = bounds[i];
+        b.center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+        b.radius = lights[i].radius;
+
+        float dmin = std::max(-b.center.z - b.radius, zNear);
+        float dmax = -b.center.z + b.radius;
+        if (dmax < zNear || dmin > zFar) {
+            b.minSlice = 1;
+            b.maxSlice = 0;
+            continue;
+        }
+        b.minSlice = std::max(0, (int)std::floor(std::log(dmin / zNear) * sliceScale));
+        b.maxSlice = std::min(slices - 1, (int)std::floor(std::log(std::min(dmax, zFar) / zNear) * sliceScale));
+    }
+
+    // slices are disjoint sets of clusters, so each thread owns its own.
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), slices);
+    if (lights.size() < minLightsForThreads) {
+        threads = 1;
+    }
+    pool.run(threads, [&](size_t t) {
+        binSlices((int)(slices * t / threads), (int)(slices * (t + 1) / threads));
+    });
+
+    // flatten into offset/count pairs and one index list.
+    indices.clear();
+    for (int c = 0; c < clusterCount; c++) {
+        grid[c*2 + 0] = (uint32_t)indices.size();
+        grid[c*2 + 1] = clusterCounts[c];
+        const uint32_t* list = &clusterLights[c * maxLightsPerCluster];
+        indices.insert(indices.end(), list, list + clusterCounts[c]);
+    }
+    if (indices.empty()) {
+        indices.push_back(0);
+    }
+
+    data.resize(std::max<size_t>(1, lights.size()) * 3);
+    for (size_t i = 0; i < lights.size(); i++) {
+        const Light& l = lights[i];
+        data[i*3 + 0] = glm::vec4(l.position, l.radius);
+        data[i*3 + 1] = glm::vec4(l.color, l.outerCone);
+        // the inner cosine must exceed the outer one, as smoothstep's edges.
+        float inner = l.outerCone > -1.0f ? std::max(l.innerCone, l.outerCone + 1e-4f) : l.innerCone;
+        data[i*3 + 2] = glm::vec4(glm::normalize(l.direction), inner);
+    }
+
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    const void* sources[3] = { data.data(), grid.data(), indices.data() };
+    const size_t sizes[3] = {
+        data.size() * sizeof(glm::vec4),
+        grid.size() * sizeof(uint32_t),
+        indices.size() * sizeof(uint32_t),
+    };
+    for (int i = 0; i < 3; i++) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, sizes[i], sources[i], GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::binSlices(int begin, int end) {
+    for (int c = begin * tilesX * tilesY; c < end * tilesX * tilesY; c++) {
+        clusterCounts[c] = 0;
+    }
+
+    for (size_t i = 0; i < bounds.size(); i++) {
+        const Bounds& b = bounds[i];
+        int first = std::max(b.minSlice, begin);
+        int last = std::min(b.maxSlice, end - 1);
+        for (int k = first; k <= last; k++) {
+            for (int c = k * tilesX * tilesY; c < (k + 1) * tilesX * tilesY; c++) {
+                // sphere against the cluster's view-space AABB.
+                glm::vec3 closest = glm::clamp(b.center, clusterMin[c], clusterMax[c]);
+                glm::vec3 d = closest - b.center;
+                if (glm::dot(d, d) > b.radius * b.radius)
+                    continue;
+                if (clusterCounts[c] < maxLightsPerCluster) {
+                    clusterLights[c * maxLightsPerCluster + clusterCounts[c]++] = (uint32_t)i;
+                }
+            }
+        }
+    }
+}
+
+ClusteredLights::Locations ClusteredLights::locate(ShaderProgram& program) {
+    program.use();
+    program.set(program.uniform("lightData"), 7);
+    program.set(program.uniform("lightGrid"), 8);
+    program.set(program.uniform("lightIndices"), 9);
+
+    Locations locations;
+    locations.view = program.uniform("uView");
+    locations.tileScale = program.uniform("clusterTileScale");
+    locations.sliceParams = program.uniform("clusterSliceParams");
+    locations.dims = program.uniform("clusterDims");
+    return locations;
+}
+
+void ClusteredLights::bind(ShaderProgram& program, const Locations& locations) {
+    float sliceScale = slices / std::log(zFar / zNear);
+    program.set(locations.view, view);
+    program.set(locations.tileScale, glm::vec2((float)tilesX / width, (float)tilesY / height));
+    program.set(locations.sliceParams, glm::vec2(sliceScale, -std::log(zNear) * sliceScale));
+    program.set(locations.dims, glm::ivec3(tilesX, tilesY, slices));
+
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE7 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "program.h"
+#include "workerpool.h"
+
+class Camera;
+
+struct Light {
+    glm::vec3 position;
+    float radius = 10.0f;
+    glm::vec3 color = glm::vec3(1.0f);
+    glm::vec3 direction = glm::vec3(0, -1, 0);
+    float innerCone = -1.0f; // cosines of the spot cone, -1 for a point light
+    float outerCone = -1.0f;
+};
+
+/* CPU-side light list binned into a view-space cluster grid (screen tiles
+ * times exponential depth slices). Binning runs on a WorkerPool; the
+ * per-cluster offset/count pairs, the flattened light index list and the
+ * light data are uploaded as texture buffers, so a fragment only iterates
+ * the lights of its own cluster. */
+class ClusteredLights {
+public:
+    static constexpr int tilesX = 16;
+    static constexpr int tilesY = 9;
+    static constexpr int slices = 24;
+    static constexpr int clusterCount = tilesX * tilesY * slices;
+    static constexpr int maxLightsPerCluster = 256;
+
+    /* texture units 7-9 are reserved for the light buffers. */
+    struct Locations {
+        ShaderProgram::Uniform view;
+        ShaderProgram::Uniform tileScale;
+        ShaderProgram::Uniform sliceParams;
+        ShaderProgram::Uniform dims;
+    };
+
+    ClusteredLights();
+    ~ClusteredLights();
+
+    uint32_t add(const Light& light);
+    void set(uint32_t index, const Light& light) { lights[index] = light; }
+    void clear() { lights.clear(); }
+    size_t getCount() { return lights.size(); }
+
+    void update(Camera* camera, int width, int height);
+
+    static Locations locate(ShaderProgram& program);
+    void bind(ShaderProgram& program, const Locations& locations);
+
+private:
+    struct Bounds {
+        glm::vec3 center; // view space
+        float radius;
+        int minSlice, maxSlice;
+    };
+
+    void buildClusters();
+    void binSlices(int begin, int end);
+
+private:
+    std::vector<Light> lights;
+    std::vector<Bounds> bounds;
+
+    glm::mat4 projection;
+    glm::vec3 clusterMin[clusterCount];
+    glm::vec3 clusterMax[clusterCount];
+    uint32_t clusterCounts[clusterCount];
+    std::vector<uint32_t> clusterLights; // maxLightsPerCluster per cluster
+
+    std::vector<uint32_t> grid;
+    std::vector<uint32_t> indices;
+    std::vector<glm::vec4> data;
+
+    glm::mat4 view;
+    float zNear, zFar;
+    int width, height;
+
+    GLuint buffers[3];
+    GLuint textures[3];
+
+    WorkerPool pool;
+};
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 #include <glad.h>
 #include <GLFW/glfw3.h>
@@ -11,6 +13,18 @@
 #include "mesh.h"
 #include "camera.h"
 #include "shaders.h"
+#include "culling.h"
+#include "depth.h"
+#include "deferred.h"
+#include "lights.h"
+#include "scheduler.h"
+#include "tonemap.h"
+#include "fxaa.h"
+#include "taa.h"
+#include "resolution.h"
+#include "texturemanager.h"
+#include "materialatlas.h"
+#include "meshlets.h"
 
 void APIENTRY DebugOutputCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam) {
     /* parameter 'message', on windows, does not end in '\n',
@@ -23,11 +37,119 @@ void APIENTRY DebugOutputCallback(GLenum source, GLenum type, GLuint id, GLenum
 #endif
 }
 
+enum AntiAliasing {
+    NoAntiAliasing,
+    FXAA,
+    MSAA2,
+    MSAA4,
+    MSAA8,
+    AntiAliasingCount,
+};
+
+const char* antiAliasingNames[AntiAliasingCount] = { "off", "fxaa", "msaa 2x", "msaa 4x", "msaa 8x" };
+
+Shaders::SampleCount antiAliasingSamples(AntiAliasing mode) {
+    switch (mode) {
+    case MSAA2: return Shaders::Samples2;
+    case MSAA4: return Shaders::Samples4;
+    case MSAA8: return Shaders::Samples8;
+    default:    return Shaders::Samples1;
+    }
+}
+
+struct Settings {
+    bool depthPrepass = true;
+    bool skyLast = true;
+    bool deferred = false;
+    bool showroom = false;
+    Shaders::Quality quality = Shaders::High;
+    AntiAliasing antiAliasing = MSAA4;
+    bool dynamicResolution = false;
+    bool materialAtlas = false;
+    bool sphereGrid = false;
+    bool sphereImpostors = false;
+    bool meshLod = true;
+    bool meshletCulling = true;
+} settings;
+
+// spheres per side of the metallic x roughness look-dev grid, all in one draw.
+constexpr int sphereGridSize = 10;
+// screen-space error, in pixels of the render size, a mesh level of detail may add.
+constexpr float lodPixelError = 1.0f;
+
+int maxSamples = 1;
+
+const char* qualityNames[Shaders::QualityCount] = { "low", "medium", "high" };
+
+void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS)
+        return;
+
+    switch (key) {
+    case GLFW_KEY_F1:
+        settings.depthPrepass = !settings.depthPrepass;
+        printf("depth prepass: %s\n", settings.depthPrepass ? "on" : "off");
+        break;
+    case GLFW_KEY_F2:
+        settings.skyLast = !settings.skyLast;
+        printf("skybox: %s\n", settings.skyLast ? "last" : "first");
+        break;
+    case GLFW_KEY_F3:
+        settings.deferred = !settings.deferred;
+        printf("shading: %s\n", settings.deferred ? "deferred" : "forward");
+        break;
+    case GLFW_KEY_F4:
+        settings.showroom = !settings.showroom;
+        printf("showroom spotlights: %s\n", settings.showroom ? "on" : "off");
+        break;
+    case GLFW_KEY_F5:
+        settings.quality = Shaders::Quality((settings.quality + 1) % Shaders::QualityCount);
+        printf("forward quality: %s\n", qualityNames[settings.quality]);
+        break;
+    case GLFW_KEY_F6:
+        // skip sample counts the driver cannot render to.
+        do {
+            settings.antiAliasing = AntiAliasing((settings.antiAliasing + 1) % AntiAliasingCount);
+        } while ((1 << antiAliasingSamples(settings.antiAliasing)) > maxSamples);
+        printf("anti-aliasing: %s%s\n", antiAliasingNames[settings.antiAliasing],
+            settings.deferred && settings.antiAliasing >= MSAA2 ? " (forward only)" : "");
+        break;
+    case GLFW_KEY_F7:
+        settings.dynamicResolution = !settings.dynamicResolution;
+        printf("dynamic resolution: %s\n", settings.dynamicResolution ? "on (msaa off)" : "off");
+        break;
+    case GLFW_KEY_F8:
+        TextureManager::report();
+        break;
+    case GLFW_KEY_F9:
+        settings.materialAtlas = !settings.materialAtlas;
+        printf("material atlas: %s\n", settings.materialAtlas ? "on (instanced)" : "off");
+        break;
+    case GLFW_KEY_F10:
+        settings.sphereGrid = !settings.sphereGrid;
+        printf("sphere grid: %s\n", settings.sphereGrid ? "on" : "off");
+        break;
+    case GLFW_KEY_F11:
+        settings.sphereImpostors = !settings.sphereImpostors;
+        printf("instanced spheres: %s\n", settings.sphereImpostors ? "impostors" : "mesh");
+        break;
+    case GLFW_KEY_F12:
+        settings.meshLod = !settings.meshLod;
+        printf("mesh levels of detail: %s\n", settings.meshLod ? "on" : "off");
+        break;
+    case GLFW_KEY_M:
+        settings.meshletCulling = !settings.meshletCulling;
+        printf("meshlet culling: %s\n", settings.meshletCulling ? "on" : "off");
+        break;
+    }
+}
+
+static void run(GLFWwindow* window);
+
 int main()
 {
     glfwInit();
     glfwDefaultWindowHints();
-    glfwWindowHint(GLFW_SAMPLES, 4);
 #ifndef _WIN32
     glfwWindowHint(GLFW_FLOATING, GLFW_TRUE); // float at center of screen for tiling WMs.
 #endif
@@ -47,6 +169,7 @@ int main()
 
     glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetKeyCallback(window, KeyCallback);
 
     glfwMakeContextCurrent(window);
     gladLoadGL();
@@ -56,40 +179,378 @@ int main()
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_FRAMEBUFFER_SRGB);
 
+    GLint limits[3];
+    glGetIntegerv(GL_MAX_SAMPLES, &limits[0]);
+    glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &limits[1]);
+    glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &limits[2]);
+    maxSamples = std::min(limits[0], std::min(limits[1], limits[2]));
+    while ((1 << antiAliasingSamples(settings.antiAliasing)) > maxSamples) {
+        settings.antiAliasing = AntiAliasing(settings.antiAliasing - 1);
+    }
+
+    run(window);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
+
+/* everything that owns GL objects lives in here, so that their destructors
+ * run while the context is still current. */
+static void run(GLFWwindow* window)
+{
     Shaders::compile();
 
     SkyboxRenderPass skybox;
-    PBRRenderPass pbr;
+    DepthRenderPass depth;
+    PBRRenderPass pbr[Shaders::QualityCount];
+    for (unsigned q = 0; q < Shaders::QualityCount; q++) {
+        pbr[q].setQuality(Shaders::Quality(q));
+    }
+    DeferredRenderPass deferred;
+    TonemapRenderPass tonemap;
+    FXAARenderPass fxaa;
+    TemporalRenderPass taa;
+
+    RenderPass::setAnisotropy(8.0f);
 
     SkyboxMaterial skyboxMaterial;
     skyboxMaterial.bake("models/dawn.hdr", "models/BRDF_LUT.dds");
 
     PBRMaterial material;
-    material.setAlbedoMap(RenderPass::loadTexture("models/MAC10_albedo.png"));
-    material.setNormalMap(RenderPass::loadTexture("models/MAC10_normal.png"));
-    material.setMetallicMap(RenderPass::makeTexture(255, 255, 255, 255));
-    material.setRoughnessMap(RenderPass::makeTexture(0, 0, 0, 255));
+    material.setAlbedoMap(TextureManager::load("models/MAC10_albedo.png", Mipmap::SRGB));
+    material.setNormalMap(TextureManager::load("models/MAC10_normal.png", Mipmap::Normal));
+    material.setMetallic(1.0f);
+    material.setRoughness(0.0f);
 
     PBRMaterial chromium;
-    chromium.setAlbedoMap(RenderPass::makeTexture(255, 255, 255, 255));
-    chromium.setNormalMap(RenderPass::makeTexture(128, 128, 255, 255));
-    chromium.setMetallicMap(RenderPass::makeTexture(255, 255, 255, 255));
-    chromium.setRoughnessMap(RenderPass::makeTexture(0, 0, 0, 255));
+    chromium.setAlbedo(glm::vec3(1.0f));
+    chromium.setMetallic(1.0f);
+    chromium.setRoughness(0.0f);
 
     PBRMaterial rustediron2; 
-    rustediron2.setAlbedoMap(RenderPass::loadTexture("models/rustediron2_basecolor.png"));
-    rustediron2.setNormalMap(RenderPass::loadTexture("models/rustediron2_normal.png"));
-    rustediron2.setMetallicMap(RenderPass::loadTexture("models/rustediron2_metallic.png"));
-    rustediron2.setRoughnessMap(RenderPass::loadTexture("models/rustediron2_roughness.png"));
+    rustediron2.setAlbedoMap(TextureManager::load("models/rustediron2_basecolor.png", Mipmap::SRGB));
+    rustediron2.setNormalMap(TextureManager::load("models/rustediron2_normal.png", Mipmap::Normal));
+    rustediron2.setORMMap(TextureManager::loadORM(nullptr, "models/rustediron2_roughness.png", "models/rustediron2_metallic.png"));
+
+    // the variants compile in the background while the rest loads.
+    for (PBRMaterial* m : { &material, &chromium, &rustediron2 }) {
+        for (PBRRenderPass& tier : pbr) {
+            tier.prepare(m);
+        }
+        deferred.prepare(m);
+    }
+    TextureManager::report();
+
+    MaterialAtlas atlas;
+    for (PBRMaterial* m : { &material, &chromium, &rustediron2 }) {
+        atlas.add(m);
+    }
+    atlas.build();
+    for (PBRRenderPass& tier : pbr) {
+        tier.prepareAtlas();
+    }
+    deferred.prepareAtlas();
+    for (PBRRenderPass& tier : pbr) {
+        tier.prepareParametric();
+    }
+    deferred.prepareParametric();
+    printf("material atlas: %d batches\n", atlas.getBatchCount());
 
     Mesh mac10;
     mac10.loadObj("models/MAC10.obj");
 
+    struct Object {
+        Mesh* mesh; // nullptr draws a unit sphere
+        glm::mat4 model;
+        PBRMaterial* material;
+        int atlasMaterial; // -1 if not in the atlas
+    };
+    std::vector<Object> objects = {
+        { &mac10, glm::mat4(1.0), &material, atlas.add(&material) },
+        { nullptr, glm::translate(glm::vec3(2, 0, 0)), &chromium, atlas.add(&chromium) },
+        { nullptr, glm::translate(glm::vec3(-2, 0, 0)), &rustediron2, atlas.add(&rustediron2) },
+    };
+
+    // with the atlas on, visible objects are grouped by geometry and atlas
+    // batch and each group is one instanced draw; the rest draw one by one.
+    // A mesh alone in its group is drawn one by one as well while meshlet
+    // culling is on, since an instanced draw cannot skip meshlets.
+    struct InstancedDraw {
+        Mesh* mesh;
+        int lod;
+        int batch;
+        uint32_t first; // the object of the first instance
+        std::vector<RenderPass::Instance> instances;
+    };
+    std::vector<InstancedDraw> instancedDraws;
+    std::vector<uint8_t> instanced(objects.size(), 0);
+    // the level each visible mesh object draws at, picked every frame.
+    std::vector<int> lods(objects.size(), 0);
+    // the meshlets of that level left by culling, for the objects drawn one by one.
+    MeshletCulling meshletCulling;
+    std::vector<uint32_t> meshletDraws(objects.size(), 0);
+    auto gatherInstances = [&](const std::vector<uint32_t>& indices) {
+        for (InstancedDraw& draw : instancedDraws) {
+            draw.instances.clear();
+        }
+        std::fill(instanced.begin(), instanced.end(), 0);
+        if (!settings.materialAtlas)
+            return;
+        for (uint32_t index : indices) {
+            const Object& object = objects[index];
+            if (object.atlasMaterial < 0)
+                continue;
+            int batch = atlas.getBatch(object.atlasMaterial);
+            auto draw = std::find_if(instancedDraws.begin(), instancedDraws.end(), [&](const InstancedDraw& d) {
+                return d.mesh == object.mesh && d.lod == lods[index] && d.batch == batch;
+            });
+            if (draw == instancedDraws.end()) {
+                draw = instancedDraws.insert(instancedDraws.end(), { object.mesh, lods[index], batch, index, {} });
+            }
+            if (draw->instances.empty()) {
+                draw->first = index;
+            }
+            draw->instances.push_back({ object.model, object.atlasMaterial });
+            instanced[index] = 1;
+        }
+        for (InstancedDraw& draw : instancedDraws) {
+            if (settings.meshletCulling && draw.mesh && draw.instances.size() == 1) {
+                draw.instances.clear();
+                instanced[draw.first] = 0;
+            }
+        }
+    };
+    auto drawnInstanced = [&](uint32_t index) {
+        return instanced[index] != 0;
+    };
+
+    // metallic rises to the right and roughness upwards, behind the scene.
+    std::vector<RenderPass::Instance> gridSpheres;
+    Culling gridCulling;
+    for (int y = 0; y < sphereGridSize; y++) {
+        for (int x = 0; x < sphereGridSize; x++) {
+            RenderPass::Instance sphere;
+            glm::vec3 position = glm::vec3(x - (sphereGridSize - 1) * 0.5f, y, -6.0f);
+            sphere.model = glm::translate(position) * glm::scale(glm::vec3(0.4f));
+            sphere.albedo = glm::vec3(0.95f, 0.64f, 0.54f);
+            sphere.metallic = x / float(sphereGridSize - 1);
+            sphere.roughness = y / float(sphereGridSize - 1);
+            gridSpheres.push_back(sphere);
+            gridCulling.add(glm::vec3(-1), glm::vec3(1), sphere.model);
+        }
+    }
+    std::vector<RenderPass::Instance> gridVisible;
+
+    Culling culling;
+    for (const Object& object : objects) {
+        if (object.mesh) {
+            culling.add(object.mesh->getBoundsMin(), object.mesh->getBoundsMax(), object.model);
+        } else {
+            culling.add(glm::vec3(-1), glm::vec3(1), object.model);
+        }
+    }
+
+    ClusteredLights lights;
+    for (PBRRenderPass& tier : pbr) {
+        tier.setLights(&lights);
+    }
+    deferred.setLights(&lights);
+
+    auto resetLights = [&] {
+        lights.clear();
+        const glm::vec3 positions[] = {
+            glm::vec3(1.0f, 0.0f, 0.0f),
+            glm::vec3(-1.0f, 0.0f, 0.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f),
+            glm::vec3(0.0f, 0.0f, -1.0f),
+        };
+        for (const glm::vec3& position : positions) {
+            Light light;
+            light.position = position;
+            light.radius = 100.0f;
+            lights.add(light);
+        }
+
+        if (!settings.showroom)
+            return;
+
+        // a ceiling grid of small colored spotlights pointing down.
+        for (int z = -16; z < 16; z++) {
+            for (int x = -16; x < 16; x++) {
+                Light light;
+                light.position = glm::vec3(x * 0.5f, 2.0f, z * 0.5f);
+                light.radius = 3.0f;
+                light.color = glm::vec3((x & 3) / 3.0f, (z & 3) / 3.0f, 1.0f - ((x ^ z) & 3) / 3.0f) * 0.2f;
+                light.direction = glm::vec3(0, -1, 0);
+                light.innerCone = 0.95f;
+                light.outerCone = 0.85f;
+                lights.add(light);
+            }
+        }
+    };
+    bool showroom = settings.showroom;
+    resetLights();
+
+    std::vector<uint32_t> visible;
+    Camera camera(window);
+
+    FrameGraph::Resource gAlbedo, gNormal, gMaterial, gDepth;
+
+    PassScheduler scheduler;
+    scheduler.getGraph().setClearColor(0.5f, 0.5f, 1.0f, 1.0f);
+    scheduler.add(PassScheduler::Depth, "depth", [&](FrameGraph::Builder& builder) {
+        builder.write(builder.get(settings.deferred ? "gbuffer.depth" : "depth"));
+    }, [&] {
+        for (uint32_t index : visible) {
+            const Object& object = objects[index];
+            if (drawnInstanced(index))
+                continue;
+            if (object.mesh) {
+                depth.drawMesh(&camera, object.mesh, meshletCulling.getRanges(meshletDraws[index]), object.model);
+            } else {
+                depth.drawSphere(&camera, object.model);
+            }
+        }
+        for (const InstancedDraw& draw : instancedDraws) {
+            if (draw.instances.empty())
+                continue;
+            if (draw.mesh) {
+                depth.drawMeshInstanced(&camera, draw.mesh, draw.lod, draw.instances.data(), (GLsizei)draw.instances.size());
+            } else {
+                depth.drawSphereInstanced(&camera, draw.instances.data(), (GLsizei)draw.instances.size());
+            }
+        }
+        if (!gridVisible.empty()) {
+            depth.drawSphereInstanced(&camera, gridVisible.data(), (GLsizei)gridVisible.size());
+        }
+    });
+    // one pass per tier, so each keeps its own GPU timing.
+    const char* pbrPassNames[Shaders::QualityCount] = { "pbr.low", "pbr.medium", "pbr.high" };
+    for (unsigned q = 0; q < Shaders::QualityCount; q++) {
+        scheduler.add(PassScheduler::Opaque, pbrPassNames[q], [&, q](FrameGraph::Builder& builder) {
+            if (settings.deferred || settings.quality != q)
+                return;
+            builder.write(builder.get("hdr"));
+            builder.write(builder.get("depth"));
+        }, [&, q] {
+            for (uint32_t index : visible) {
+                const Object& object = objects[index];
+                if (drawnInstanced(index))
+                    continue;
+                if (object.mesh) {
+                    pbr[q].drawMesh(&camera, object.mesh, meshletCulling.getRanges(meshletDraws[index]), object.model, object.material, &skyboxMaterial);
+                } else {
+                    pbr[q].drawSphere(&camera, object.model, object.material, &skyboxMaterial);
+                }
+            }
+            for (const InstancedDraw& draw : instancedDraws) {
+                if (draw.instances.empty())
+                    continue;
+                if (draw.mesh) {
+                    pbr[q].drawMeshInstanced(&camera, draw.mesh, draw.lod, draw.instances.data(), (GLsizei)draw.instances.size(), &atlas, draw.batch, &skyboxMaterial);
+                } else {
+                    pbr[q].drawSphereInstanced(&camera, draw.instances.data(), (GLsizei)draw.instances.size(), &atlas, draw.batch, &skyboxMaterial);
+                }
+            }
+            if (!gridVisible.empty()) {
+                pbr[q].drawSphereParametric(&camera, gridVisible.data(), (GLsizei)gridVisible.size(), &skyboxMaterial);
+            }
+        });
+    }
+    scheduler.add(PassScheduler::Opaque, "gbuffer", [&](FrameGraph::Builder& builder) {
+        if (!settings.deferred)
+            return;
+        gAlbedo = builder.write(builder.get("gbuffer.albedo"));
+        gNormal = builder.write(builder.get("gbuffer.normal"));
+        gMaterial = builder.write(builder.get("gbuffer.material"));
+        gDepth = builder.write(builder.get("gbuffer.depth"));
+    }, [&] {
+        for (uint32_t index : visible) {
+            const Object& object = objects[index];
+            if (drawnInstanced(index))
+                continue;
+            if (object.mesh) {
+                deferred.drawMesh(&camera, object.mesh, meshletCulling.getRanges(meshletDraws[index]), object.model, object.material);
+            } else {
+                deferred.drawSphere(&camera, object.model, object.material);
+            }
+        }
+        for (const InstancedDraw& draw : instancedDraws) {
+            if (draw.instances.empty())
+                continue;
+            if (draw.mesh) {
+                deferred.drawMeshInstanced(&camera, draw.mesh, draw.lod, draw.instances.data(), (GLsizei)draw.instances.size(), &atlas, draw.batch);
+            } else {
+                deferred.drawSphereInstanced(&camera, draw.instances.data(), (GLsizei)draw.instances.size(), &atlas, draw.batch);
+            }
+        }
+        if (!gridVisible.empty()) {
+            deferred.drawSphereParametric(&camera, gridVisible.data(), (GLsizei)gridVisible.size());
+        }
+    });
+    scheduler.add(PassScheduler::Lighting, "lighting", [&](FrameGraph::Builder& builder) {
+        if (!settings.deferred)
+            return;
+        builder.read(gAlbedo);
+        builder.read(gNormal);
+        builder.read(gMaterial);
+        builder.read(gDepth);
+        builder.write(builder.get("hdr"));
+        builder.write(builder.get("depth"));
+    }, [&] {
+        FrameGraph& graph = scheduler.getGraph();
+        deferred.drawLighting(&camera, &skyboxMaterial,
+            graph.getTexture(gAlbedo), graph.getTexture(gNormal),
+            graph.getTexture(gMaterial), graph.getTexture(gDepth));
+    });
+    scheduler.add(PassScheduler::Sky, "skybox", [&](FrameGraph::Builder& builder) {
+        builder.write(builder.get("hdr"));
+        builder.write(builder.get("depth"));
+    }, [&] {
+        skybox.drawSkybox(&camera, &skyboxMaterial);
+    });
+    FrameGraph::Resource taaColor, taaDepth, taaHistory;
+    scheduler.add(PassScheduler::Post, "taa", [&](FrameGraph::Builder& builder) {
+        if (!settings.dynamicResolution)
+            return;
+        taaColor = builder.read(builder.get("hdr"));
+        taaDepth = builder.read(builder.get("depth"));
+        taaHistory = builder.read(builder.get("taa.history"));
+        builder.write(builder.get("taa"), false);
+    }, [&] {
+        FrameGraph& graph = scheduler.getGraph();
+        taa.draw(&camera, graph.getTexture(taaColor), graph.getTexture(taaDepth));
+    });
+    // multisampled scene targets are resolved by the tonemap pass itself.
+    Shaders::SampleCount samples = Shaders::Samples1;
+    FrameGraph::Resource hdr, ldr;
+    scheduler.add(PassScheduler::Post, "tonemap", [&](FrameGraph::Builder& builder) {
+        hdr = builder.read(builder.get(settings.dynamicResolution ? "taa" : "hdr"), false);
+        builder.write(builder.get(settings.antiAliasing == FXAA ? "ldr" : "backbuffer"));
+    }, [&] {
+        tonemap.draw(scheduler.getGraph().getTexture(hdr, false), samples);
+    });
+    scheduler.add(PassScheduler::Post, "fxaa", [&](FrameGraph::Builder& builder) {
+        if (settings.antiAliasing != FXAA)
+            return;
+        ldr = builder.read(builder.get("ldr"));
+        builder.write(builder.get("backbuffer"));
+    }, [&] {
+        fxaa.draw(scheduler.getGraph().getTexture(ldr));
+    });
+
+    double lastReport = 0;
+    AntiAliasing reportedAntiAliasing = settings.antiAliasing;
+    float antiAliasingMilliseconds[AntiAliasingCount] = {};
+
     int framerate = 120;
     double lastTime = 0;
-    Camera camera(window);
 
-    glClearColor(0.5f, 0.5f, 1.0f, 1.0f);
+    // the scaler holds GPU time in a band just under the frame budget.
+    ResolutionScaler scaler;
+    scaler.setTarget(1000.0f / framerate);
+    bool dynamicResolution = settings.dynamicResolution;
+
     while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS && !glfwWindowShouldClose(window)) {
         float deltaTime = float(glfwGetTime() - lastTime);
         while (glfwGetTime() < (lastTime + 1.0/framerate)) {
@@ -98,20 +559,137 @@ int main()
         }
         lastTime = glfwGetTime();
 
+        // programs not yet needed by a draw keep compiling on the driver's threads.
+        RenderPass::pollPrograms();
+
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+
+        if (dynamicResolution != settings.dynamicResolution) {
+            dynamicResolution = settings.dynamicResolution;
+            scaler.reset();
+            taa.reset();
+        }
+        int renderWidth = framebufferWidth, renderHeight = framebufferHeight;
+        camera.jitter = glm::vec2(0.0f);
+        if (settings.dynamicResolution) {
+            scaler.getSize(framebufferWidth, framebufferHeight, &renderWidth, &renderHeight);
+            camera.jitter = taa.nextJitter(renderWidth, renderHeight);
+            taa.resize(framebufferWidth, framebufferHeight);
+        }
+
         camera.update(deltaTime);
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        visible = culling.cull(camera.frustum);
+        for (uint32_t index : visible) {
+            const Object& object = objects[index];
+            lods[index] = settings.meshLod && object.mesh ? object.mesh->selectLod(&camera, object.model, renderHeight, lodPixelError) : 0;
+        }
+        gatherInstances(visible);
+        meshletCulling.clear();
+        meshletCulling.setEnabled(settings.meshletCulling);
+        for (uint32_t index : visible) {
+            const Object& object = objects[index];
+            if (!object.mesh || drawnInstanced(index))
+                continue;
+            const Mesh::Lod& lod = object.mesh->getLod(lods[index]);
+            meshletDraws[index] = meshletCulling.add(object.mesh->getMeshlets(lods[index]), lod.meshletCount, object.model);
+        }
+        meshletCulling.cull(&camera);
+        gridVisible.clear();
+        if (settings.sphereGrid) {
+            for (uint32_t index : gridCulling.cull(camera.frustum)) {
+                gridVisible.push_back(gridSpheres[index]);
+            }
+        }
 
-        skybox.drawSkybox(&camera, &skyboxMaterial);
+        if (showroom != settings.showroom) {
+            showroom = settings.showroom;
+            resetLights();
+        }
+        scheduler.setDepthPrepass(settings.depthPrepass);
+        depth.setSphereImpostors(settings.sphereImpostors);
+        for (PBRRenderPass& tier : pbr) {
+            tier.setSphereImpostors(settings.sphereImpostors);
+        }
+        deferred.setSphereImpostors(settings.sphereImpostors);
+        scheduler.setSkyOrder(settings.skyLast ? PassScheduler::SkyLast : PassScheduler::SkyFirst);
+        lights.update(&camera, renderWidth, renderHeight);
+        scheduler.beginFrame(framebufferWidth, framebufferHeight);
+        FrameGraph& graph = scheduler.getGraph();
+        FrameGraph::TextureDesc desc;
+        desc.width = framebufferWidth;
+        desc.height = framebufferHeight;
+        if (settings.antiAliasing == FXAA) {
+            desc.format = TonemapRenderPass::ldrFormat;
+            graph.create("ldr", desc);
+        }
+        if (settings.dynamicResolution) {
+            desc.format = TemporalRenderPass::historyFormat;
+            graph.importTexture("taa.history", taa.getHistory(), desc);
+            graph.importTexture("taa", taa.getTarget(), desc);
+        }
+        // everything up to the tonemap, or the taa pass, runs at the render size.
+        desc.width = renderWidth;
+        desc.height = renderHeight;
+        // the G-buffer stays single-sampled, so MSAA only applies to forward
+        // shading, and temporal reconstruction replaces it.
+        samples = settings.deferred || settings.dynamicResolution ? Shaders::Samples1 : antiAliasingSamples(settings.antiAliasing);
+        desc.samples = 1 << samples;
+        desc.format = TonemapRenderPass::hdrFormat;
+        graph.create("hdr", desc);
+        desc.format = TonemapRenderPass::depthFormat;
+        graph.create("depth", desc);
+        desc.samples = 1;
+        if (settings.deferred) {
+            desc.format = DeferredRenderPass::albedoFormat;
+            graph.create("gbuffer.albedo", desc);
+            desc.format = DeferredRenderPass::normalFormat;
+            graph.create("gbuffer.normal", desc);
+            desc.format = DeferredRenderPass::materialFormat;
+            graph.create("gbuffer.material", desc);
+            desc.format = DeferredRenderPass::depthFormat;
+            graph.create("gbuffer.depth", desc);
+        }
+        scheduler.execute();
+
+        float total = 0;
+        for (size_t i = 0; i < scheduler.getPassCount(); i++) {
+            if (scheduler.wasExecuted(i))
+                total += scheduler.getMilliseconds(i);
+        }
+        if (settings.dynamicResolution) {
+            scaler.update(total);
+        }
 
-        pbr.drawMesh(&camera, &mac10, glm::mat4(1.0), &material, &skyboxMaterial);
-        pbr.drawSphere(&camera, glm::translate(glm::vec3(2, 0, 0)), &chromium, &skyboxMaterial);
-        pbr.drawSphere(&camera, glm::translate(glm::vec3(-2, 0, 0)), &rustediron2, &skyboxMaterial);
+        if (lastTime - lastReport >= 1.0) {
+            for (size_t i = 0; i < scheduler.getPassCount(); i++) {
+                if (scheduler.wasExecuted(i))
+                    printf("%s %.3f ms  ", scheduler.getPassName(i), scheduler.getMilliseconds(i));
+            }
+            printf("\n");
+            if (settings.meshletCulling) {
+                printf("meshlets: %zu of %zu drawn\n", meshletCulling.getVisibleCount(), meshletCulling.getMeshletCount());
+            }
+            if (settings.dynamicResolution) {
+                printf("render size: %dx%d (%.0f%%)\n", renderWidth, renderHeight, scaler.getScale() * 100);
+            }
+
+            // pass timings are smoothed, so a mode is only recorded once it ran a full report.
+            if (reportedAntiAliasing == settings.antiAliasing) {
+                antiAliasingMilliseconds[settings.antiAliasing] = total;
+                printf("frame by anti-aliasing:");
+                for (int i = 0; i < AntiAliasingCount; i++) {
+                    if (antiAliasingMilliseconds[i] > 0)
+                        printf("  %s %.3f ms", antiAliasingNames[i], antiAliasingMilliseconds[i]);
+                }
+                printf("\n");
+            }
+            reportedAntiAliasing = settings.antiAliasing;
+            lastReport = lastTime;
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
-
-    glfwDestroyWindow(window);
-    glfwTerminate();
 }
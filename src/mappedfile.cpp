@@ -0,0 +1,76 @@
+#include "mappedfile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const char* path)
+    : data(nullptr)
+    , size(0)
+    , file(INVALID_HANDLE_VALUE)
+    , mapping(nullptr)
+{
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        throw std::runtime_error(path);
+    }
+    size = (size_t)fileSize.QuadPart;
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+        data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!data) {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error(path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const char* path)
+    : data(nullptr)
+    , size(0)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+        if (fd >= 0)
+            close(fd);
+        throw std::runtime_error(path);
+    }
+    size = (size_t)info.st_size;
+
+    // the mapping holds its own reference to the file.
+    void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+        throw std::runtime_error(path);
+    data = (const uint8_t*)address;
+
+    // uploads read every byte front to back.
+    madvise(address, size, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+    munmap((void*)data, size);
+}
+#endif
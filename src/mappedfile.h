@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/* A file mapped read-only into memory for as long as the object lives, so
+ * that its contents can be handed to GL without reading them into a copy. */
+class MappedFile {
+public:
+    /* throws std::runtime_error if the file cannot be opened or is empty. */
+    explicit MappedFile(const char* path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#endif
+};
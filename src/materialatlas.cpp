@@ -0,0 +1,197 @@
+#include "materialatlas.h"
+#include "pbr.h"
+#include <algorithm>
+#include <glm/glm.hpp>
+
+MaterialAtlas::MaterialAtlas() {
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &texture);
+}
+
+MaterialAtlas::~MaterialAtlas() {
+    for (Array& array : arrays) {
+        glDeleteTextures(1, &array.texture);
+    }
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &buffer);
+}
+
+int MaterialAtlas::add(PBRMaterial* material) {
+    auto known = indices.find(material);
+    if (known != indices.end())
+        return known->second;
+
+    // the shader reads metallic and roughness from the ORM layer or the constants.
+    if (material->getORMMap() == 0 && (material->getMetallicMap() != 0 || material->getRoughnessMap() != 0))
+        return -1;
+
+    Material m;
+    m.material = material;
+    GLuint maps[ChannelCount] = { material->getAlbedoMap(), material->getNormalMap(), material->getORMMap() };
+    for (int c = 0; c < ChannelCount; c++) {
+        m.array[c] = maps[c] != 0 ? findArray(maps[c]) : -1;
+        m.layer[c] = -1;
+        if (m.array[c] >= 0) {
+            std::vector<GLuint>& sources = arrays[m.array[c]].sources;
+            m.layer[c] = int(std::find(sources.begin(), sources.end(), maps[c]) - sources.begin());
+        }
+    }
+    m.batch = findBatch(m);
+
+    int index = (int)materials.size();
+    materials.push_back(m);
+    indices[material] = index;
+    return index;
+}
+
+/* an array of the source's size class that holds it already or has room for it. */
+int MaterialAtlas::findArray(GLuint source) {
+    GLint format, width, height;
+    glBindTexture(GL_TEXTURE_2D, source);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    int levels = 1;
+    for (;; levels++) {
+        GLint w = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, levels, GL_TEXTURE_WIDTH, &w);
+        if (w == 0)
+            break;
+    }
+
+    int room = -1;
+    for (size_t i = 0; i < arrays.size(); i++) {
+        Array& array = arrays[i];
+        if (array.format != GLenum(format) || array.width != width || array.height != height || array.levels != levels)
+            continue;
+        if (std::find(array.sources.begin(), array.sources.end(), source) != array.sources.end())
+            return (int)i;
+        if (room < 0 && (int)array.sources.size() < maxLayers)
+            room = (int)i;
+    }
+    if (room < 0) {
+        room = (int)arrays.size();
+        arrays.push_back({ GLenum(format), width, height, levels, {}, 0 });
+    }
+    arrays[room].sources.push_back(source);
+    return room;
+}
+
+/* the first batch whose arrays agree with the material's; constant channels fit anywhere. */
+int MaterialAtlas::findBatch(const Material& material) {
+    for (size_t i = 0; i < batches.size(); i++) {
+        Batch& batch = batches[i];
+        bool fits = true;
+        for (int c = 0; c < ChannelCount; c++) {
+            if (material.array[c] >= 0 && batch.array[c] >= 0 && material.array[c] != batch.array[c])
+                fits = false;
+        }
+        if (!fits)
+            continue;
+        for (int c = 0; c < ChannelCount; c++) {
+            if (material.array[c] >= 0)
+                batch.array[c] = material.array[c];
+        }
+        return (int)i;
+    }
+    batches.push_back({ { material.array[Albedo], material.array[Normal], material.array[ORM] } });
+    return (int)batches.size() - 1;
+}
+
+/* read back from the source and written into the layer, level by level. GL 3.3
+ * has no glCopyImageSubData, and blits cannot copy block-compressed images. */
+void MaterialAtlas::copyLayer(const Array& array, int layer) {
+    std::vector<uint8_t> pixels;
+    glBindTexture(GL_TEXTURE_2D, array.sources[layer]);
+    for (int level = 0; level < array.levels; level++) {
+        GLint width = std::max(array.width >> level, 1);
+        GLint height = std::max(array.height >> level, 1);
+        GLint compressed, size;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            pixels.resize(size);
+            glGetCompressedTexImage(GL_TEXTURE_2D, level, pixels.data());
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, array.format, size, pixels.data());
+        } else {
+            // 8-bit channels round-trip as bytes (sRGB ones undecoded), anything wider as floats.
+            GLint bits, type;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_RED_SIZE, &bits);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_RED_TYPE, &type);
+            GLenum transfer = bits == 8 && type == GL_UNSIGNED_NORMALIZED ? GL_UNSIGNED_BYTE : GL_FLOAT;
+            pixels.resize(size_t(width) * height * 4 * (transfer == GL_FLOAT ? sizeof(float) : 1));
+            glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, transfer, pixels.data());
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGBA, transfer, pixels.data());
+        }
+    }
+}
+
+void MaterialAtlas::build() {
+    for (Array& array : arrays) {
+        glDeleteTextures(1, &array.texture);
+        glGenTextures(1, &array.texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+
+        // sampled like the source: its filtering, wrapping and anisotropy.
+        GLint minFilter, magFilter, wrapS, wrapT;
+        GLfloat anisotropy = 1.0f;
+        glBindTexture(GL_TEXTURE_2D, array.sources[0]);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &minFilter);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &magFilter);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &wrapS);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &wrapT);
+        if (GLAD_GL_EXT_texture_filter_anisotropic) {
+            glGetTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
+        }
+
+        GLsizei layers = (GLsizei)array.sources.size();
+        for (int level = 0; level < array.levels; level++) {
+            GLint width = std::max(array.width >> level, 1);
+            GLint height = std::max(array.height >> level, 1);
+            GLint compressed;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+            if (compressed) {
+                GLint size;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.format, width, height, layers, 0, size * layers, NULL);
+            } else {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.format, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, magFilter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrapS);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrapT);
+        if (anisotropy > 1.0f) {
+            glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+        }
+
+        for (int layer = 0; layer < layers; layer++) {
+            copyLayer(array, layer);
+        }
+    }
+
+    std::vector<glm::vec4> data;
+    data.reserve(materials.size() * texelsPerMaterial);
+    for (const Material& m : materials) {
+        data.push_back(glm::vec4(m.material->getAlbedo(), m.material->getMetallic()));
+        data.push_back(glm::vec4(m.material->getRoughness(), m.layer[Albedo], m.layer[Normal], m.layer[ORM]));
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(glm::vec4), data.data(), GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void MaterialAtlas::bind(int batch) {
+    for (int c = 0; c < ChannelCount; c++) {
+        int array = batches[batch].array[c];
+        glActiveTexture(GL_TEXTURE0 + c);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array >= 0 ? arrays[array].texture : 0);
+    }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+}
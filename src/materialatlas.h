@@ -0,0 +1,81 @@
+#pragma once
+#include <glad.h>
+#include <vector>
+#include <unordered_map>
+#include "shaders.h"
+
+class PBRMaterial;
+
+/* Material maps gathered into GL_TEXTURE_2D_ARRAY layers, one array per
+ * size class (format, size and mip count), with every material's
+ * constants and layers in a texture buffer. An instanced draw then shades
+ * instances of different materials, each picking its own layers by
+ * material index (see RenderPass::Instance), as long as the materials
+ * are in the same batch: a batch is a set of materials whose textured
+ * channels share arrays, so one binding serves all of them.
+ * Only albedo, normal and packed ORM maps are supported; a material with
+ * separate metallic or roughness maps is not added. The materials keep
+ * their own maps, which draws outside the atlas still sample. */
+class MaterialAtlas {
+public:
+    MaterialAtlas();
+    ~MaterialAtlas();
+
+    /* the material's index, or -1 if it cannot be packed. Maps are copied
+     * and constants read by build, so they must be set by then. */
+    int add(PBRMaterial* material);
+    /* copies the maps into the arrays and uploads the material data; call
+     * after the last add, and again to pick up changed constants. */
+    void build();
+
+    int getBatch(int material) { return materials[material].batch; }
+    int getBatchCount() { return (int)batches.size(); }
+    /* binds the batch's arrays to units 0-2 (albedo, normal, ORM) and the
+     * material data to unit 3. */
+    void bind(int batch);
+
+    /* texels of material data, RGBA32F, per material:
+     * (albedo, metallic) and (roughness, albedo layer, normal layer, ORM layer),
+     * layers being -1 for channels without a map. */
+    static constexpr int texelsPerMaterial = 2;
+
+    /* the shader variant of the instanced draws; per-material features are runtime branches. */
+    static constexpr unsigned variant = Shaders::MaterialAtlas | Shaders::NormalMap | Shaders::VertexTangents;
+
+private:
+    enum Channel { Albedo, Normal, ORM, ChannelCount };
+
+    struct Array {
+        GLenum format;
+        int width;
+        int height;
+        int levels;
+        std::vector<GLuint> sources; // one per layer
+        GLuint texture;
+    };
+
+    struct Material {
+        PBRMaterial* material;
+        int array[ChannelCount]; // -1 for constant channels
+        int layer[ChannelCount];
+        int batch;
+    };
+
+    struct Batch {
+        int array[ChannelCount]; // -1 until a material textures the channel
+    };
+
+    int findArray(GLuint source);
+    void copyLayer(const Array& array, int layer);
+    int findBatch(const Material& material);
+
+private:
+    std::vector<Array> arrays;
+    std::vector<Material> materials;
+    std::vector<Batch> batches;
+    std::unordered_map<PBRMaterial*, int> indices;
+    int maxLayers;
+
+    GLuint buffer;
+    GLuint texture;
+};
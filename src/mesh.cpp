@@ -1,11 +1,27 @@
 #include "mesh.h"
+#include "camera.h"
+#include "simplify.h"
+#include "texturecache.h"
 #include <string>
 #include <vector>
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <algorithm>
 #include <stdexcept>
+#include <filesystem>
 #include <unordered_map>
 #include <glm/gtx/hash.hpp>
 #include <tiny_obj_loader.hpp>
 
+constexpr int maxLods = 8; // levels of detail, the source mesh included
+constexpr float lodReduction = 0.5f; // triangles of a level relative to the previous one
+constexpr uint32_t minLodTriangles = 64; // no coarser level is built below this
+constexpr float minLodGain = 0.9f; // a level keeping more of the previous one's triangles ends the chain
+
+constexpr uint32_t meshCacheMagic = 0x4D445242; // "BRDM"
+constexpr uint32_t meshCacheVersion = 2;
+
 Mesh::Mesh() {
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
@@ -17,12 +33,44 @@ Mesh::Mesh() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoords));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
 }
 
 void Mesh::loadObj(const char* path)
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+
+    if (!loadCache(path, vertices, indices)) {
+        parseObj(path, vertices, indices);
+        computeTangents(vertices, indices);
+
+        boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (const auto& vertex : vertices) {
+            boundsMin = glm::min(boundsMin, vertex.position);
+            boundsMax = glm::max(boundsMax, vertex.position);
+        }
+
+        buildLods(vertices, indices);
+        buildMeshlets(vertices, indices);
+        storeCache(path, vertices, indices);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+
+    count = (int)lods[0].count;
+}
+
+void Mesh::parseObj(const char* path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
 {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
@@ -32,9 +80,6 @@ void Mesh::loadObj(const char* path)
         throw std::runtime_error(warn + err);
     }
 
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-
     std::unordered_map<glm::ivec3, uint32_t> uniqueVertices{};
     for (const auto& shape : shapes) {
         for (const auto& index : shape.mesh.indices) {
@@ -68,12 +113,198 @@ void Mesh::loadObj(const char* path)
             indices.push_back(uniqueVertices[vtx]);
         }
     }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+/* each level simplifies the source mesh rather than the previous level, so
+ * its error is measured against the surface that is actually drawn up close.
+ * The levels are appended to indices. */
+void Mesh::buildLods(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    lods.clear();
+    lods.push_back({ 0, (uint32_t)indices.size(), 0.0f, 0, 0 });
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        positions[i] = vertices[i].position;
+    }
+    const std::vector<uint32_t> source = indices;
 
-    count = (int)indices.size();
+    size_t target = source.size();
+    while ((int)lods.size() < maxLods) {
+        target = size_t(target / 3 * lodReduction) * 3;
+        if (target / 3 < minLodTriangles)
+            break;
+
+        float error;
+        std::vector<uint32_t> level = Simplify::simplify(positions, source, target, &error);
+        if (level.empty() || level.size() > lods.back().count * minLodGain)
+            break;
+
+        lods.push_back({ (uint32_t)indices.size(), (uint32_t)level.size(), std::max(error, lods.back().error), 0, 0 });
+        indices.insert(indices.end(), level.begin(), level.end());
+    }
+}
+
+void Mesh::buildMeshlets(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        positions[i] = vertices[i].position;
+    }
+
+    meshlets.clear();
+    for (Lod& lod : lods) {
+        lod.firstMeshlet = (uint32_t)meshlets.size();
+        Meshlets::build(positions, indices, lod.first, lod.count, meshlets);
+        lod.meshletCount = (uint32_t)meshlets.size() - lod.firstMeshlet;
+    }
+}
+
+bool Mesh::loadCache(const char* path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    // a miss leaves everything empty for parseObj and buildLods to fill.
+    vertices.clear();
+    indices.clear();
+    lods.clear();
+    meshlets.clear();
+
+    std::ifstream file(TextureCache::path(TextureCache::makeKey(path, "mesh"), ".mesh"), std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    uint64_t length = (uint64_t)file.tellg();
+    file.seekg(0);
+
+    uint32_t header[6];
+    if (length < sizeof(header) || !file.read((char*)header, sizeof(header)) ||
+        header[0] != meshCacheMagic || header[1] != meshCacheVersion || header[4] == 0)
+        return false;
+    // the counts must account for the whole file before anything is allocated from them.
+    uint64_t expected = sizeof(header) + 2 * sizeof(glm::vec3) + uint64_t(header[2]) * sizeof(Vertex) +
+        uint64_t(header[3]) * sizeof(uint32_t) + uint64_t(header[4]) * sizeof(Lod) + uint64_t(header[5]) * sizeof(Meshlet);
+    if (expected != length)
+        return false;
+
+    glm::vec3 min, max;
+    std::vector<Vertex> loadedVertices(header[2]);
+    std::vector<uint32_t> loadedIndices(header[3]);
+    std::vector<Lod> loadedLods(header[4]);
+    std::vector<Meshlet> loadedMeshlets(header[5]);
+    if (!file.read((char*)&min, sizeof(min)) || !file.read((char*)&max, sizeof(max)) ||
+        !file.read((char*)loadedVertices.data(), loadedVertices.size() * sizeof(Vertex)) ||
+        !file.read((char*)loadedIndices.data(), loadedIndices.size() * sizeof(uint32_t)) ||
+        !file.read((char*)loadedLods.data(), loadedLods.size() * sizeof(Lod)) ||
+        !file.read((char*)loadedMeshlets.data(), loadedMeshlets.size() * sizeof(Meshlet)))
+        return false;
+
+    // the ranges are drawn as they are, so they must stay inside the buffers.
+    for (uint32_t index : loadedIndices) {
+        if (index >= loadedVertices.size())
+            return false;
+    }
+    for (const Lod& lod : loadedLods) {
+        if (uint64_t(lod.first) + lod.count > loadedIndices.size() ||
+            uint64_t(lod.firstMeshlet) + lod.meshletCount > loadedMeshlets.size())
+            return false;
+    }
+    for (const Meshlet& meshlet : loadedMeshlets) {
+        if (uint64_t(meshlet.first) + meshlet.count > loadedIndices.size())
+            return false;
+    }
+
+    boundsMin = min;
+    boundsMax = max;
+    vertices.swap(loadedVertices);
+    indices.swap(loadedIndices);
+    lods.swap(loadedLods);
+    meshlets.swap(loadedMeshlets);
+    return true;
+}
+
+void Mesh::storeCache(const char* path, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    std::string cached = TextureCache::path(TextureCache::makeKey(path, "mesh"), ".mesh");
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cached).parent_path(), error);
+
+    std::ofstream file(cached, std::ios::binary);
+    uint32_t header[6] = { meshCacheMagic, meshCacheVersion, (uint32_t)vertices.size(), (uint32_t)indices.size(),
+        (uint32_t)lods.size(), (uint32_t)meshlets.size() };
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)&boundsMin, sizeof(boundsMin));
+    file.write((const char*)&boundsMax, sizeof(boundsMax));
+    file.write((const char*)vertices.data(), vertices.size() * sizeof(Vertex));
+    file.write((const char*)indices.data(), indices.size() * sizeof(uint32_t));
+    file.write((const char*)lods.data(), lods.size() * sizeof(Lod));
+    file.write((const char*)meshlets.data(), meshlets.size() * sizeof(Meshlet));
+}
+
+void Mesh::draw(const DrawRanges& ranges)
+{
+    if (ranges.counts.empty())
+        return;
+    glBindVertexArray(vao);
+    glMultiDrawElements(GL_TRIANGLES, ranges.counts.data(), GL_UNSIGNED_INT, ranges.offsets.data(), (GLsizei)ranges.counts.size());
+}
+
+int Mesh::selectLod(Camera* camera, const glm::mat4& model, int viewportHeight, float pixelError)
+{
+    float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+    glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+    float radius = glm::length(boundsMax - boundsMin) * 0.5f * scale;
+
+    float distance = glm::length(center - camera->position) - radius;
+    if (distance <= camera->zNear)
+        return 0;
+
+    // pixels covered by one world unit at that distance.
+    float pixels = viewportHeight / (2.0f * distance * std::tan(glm::radians(camera->fov) * 0.5f));
+    int level = 0;
+    for (int i = 1; i < (int)lods.size(); i++) {
+        if (lods[i].error * scale * pixels <= pixelError)
+            level = i;
+    }
+    return level;
+}
+
+void Mesh::computeTangents(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t i0 = indices[i + 0], i1 = indices[i + 1], i2 = indices[i + 2];
+        const Vertex& v0 = vertices[i0];
+        const Vertex& v1 = vertices[i1];
+        const Vertex& v2 = vertices[i2];
+
+        glm::vec3 e1 = v1.position - v0.position;
+        glm::vec3 e2 = v2.position - v0.position;
+        glm::vec2 d1 = v1.texcoords - v0.texcoords;
+        glm::vec2 d2 = v2.texcoords - v0.texcoords;
+
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if (std::abs(det) < 1e-12f)
+            continue; // no usable uv gradient
+
+        // not normalized, so larger triangles weigh more.
+        float r = 1.0f / det;
+        glm::vec3 t = (e1 * d2.y - e2 * d1.y) * r;
+        glm::vec3 b = (e2 * d1.x - e1 * d2.x) * r;
+        for (uint32_t index : { i0, i1, i2 }) {
+            tangents[index] += t;
+            bitangents[index] += b;
+        }
+    }
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        glm::vec3 n = vertices[i].normal;
+        glm::vec3 t = tangents[i] - n * glm::dot(n, tangents[i]);
+        if (glm::dot(t, t) < 1e-12f) {
+            // any vector perpendicular to the normal.
+            t = glm::cross(n, std::abs(n.y) < 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0));
+        }
+        t = glm::normalize(t);
+        float w = glm::dot(glm::cross(n, t), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+        vertices[i].tangent = glm::vec4(t, w);
+    }
 }
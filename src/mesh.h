@@ -1,6 +1,11 @@
 #pragma once
 #include <glad.h>
 #include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "meshlets.h"
+
+class Camera;
 
 class Mesh {
 public:
@@ -8,18 +13,56 @@ public:
         glm::vec3 position;
         glm::vec3 normal;
         glm::vec2 texcoords;
+        glm::vec4 tangent; // w is the bitangent sign
+    };
+
+    /* a level of detail: a range of the shared index buffer, and the
+     * simplification error in object space. Level 0 is the source mesh.
+     * The range is ordered by meshlet. */
+    struct Lod {
+        uint32_t first;
+        uint32_t count;
+        float error;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
     };
 
 public:
     Mesh();
     void loadObj(const char* path);
 
+    /* per-vertex tangents of an indexed triangle list, orthogonalized
+     * against the normal, with handedness in w. */
+    static void computeTangents(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
     GLuint getVAO() { return vao; }
     GLuint getCount() { return count; }
+    int getLodCount() { return (int)lods.size(); }
+    const Lod& getLod(int level) { return lods[level]; }
+    const Meshlet* getMeshlets(int level) { return &meshlets[lods[level].firstMeshlet]; }
+    /* binds the vao and draws the ranges, e.g. a level's visible meshlets. */
+    void draw(const DrawRanges& ranges);
+    /* the coarsest level whose error, projected at the nearest point of the
+     * bounding sphere, stays under pixelError pixels of a viewport
+     * viewportHeight pixels high. */
+    int selectLod(Camera* camera, const glm::mat4& model, int viewportHeight, float pixelError);
+    glm::vec3 getBoundsMin() { return boundsMin; }
+    glm::vec3 getBoundsMax() { return boundsMax; }
+
+private:
+    void parseObj(const char* path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    void buildLods(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    void buildMeshlets(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    bool loadCache(const char* path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    void storeCache(const char* path, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
 
 private:
     GLuint vao;
     GLuint vbo;
     GLuint ibo;
     int count;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    std::vector<Lod> lods;
+    std::vector<Meshlet> meshlets;
 };
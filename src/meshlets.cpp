@@ -0,0 +1,252 @@
+#include "meshlets.h"
+#include "camera.h"
+
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <algorithm>
+
+/* below this many meshlets per thread, waking workers costs more than it saves. */
+constexpr size_t minMeshletsPerThread = 4096;
+/* a draw with fewer meshlets is drawn whole: the extra ranges would cost more than they cull. */
+constexpr uint32_t minMeshletsToCull = 16;
+
+void DrawRanges::clear()
+{
+    counts.clear();
+    offsets.clear();
+}
+
+void DrawRanges::add(uint32_t first, uint32_t count)
+{
+    const void* offset = (const void*)(first * sizeof(uint32_t));
+    if (!counts.empty() && (const char*)offsets.back() + counts.back() * sizeof(uint32_t) == offset) {
+        counts.back() += count;
+        return;
+    }
+    counts.push_back(count);
+    offsets.push_back(offset);
+}
+
+namespace Meshlets {
+    static void computeBounds(const std::vector<glm::vec3>& positions, const uint32_t* indices, Meshlet& m)
+    {
+        glm::vec3 lo(std::numeric_limits<float>::max());
+        glm::vec3 hi(-std::numeric_limits<float>::max());
+        for (uint32_t i = 0; i < m.count; i++) {
+            lo = glm::min(lo, positions[indices[i]]);
+            hi = glm::max(hi, positions[indices[i]]);
+        }
+        m.center = (lo + hi) * 0.5f;
+        m.radius = 0.0f;
+        for (uint32_t i = 0; i < m.count; i++) {
+            m.radius = std::max(m.radius, glm::length(positions[indices[i]] - m.center));
+        }
+
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (uint32_t i = 0; i < m.count; i += 3) {
+            glm::vec3 p0 = positions[indices[i]], p1 = positions[indices[i + 1]], p2 = positions[indices[i + 2]];
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+            if (area == 0.0f)
+                continue;
+            normals.push_back(n / area);
+            axis += normals.back();
+        }
+        float length = glm::length(axis);
+        m.coneAxis = length > 0.0f ? axis / length : glm::vec3(0, 0, 1);
+        float minDot = length > 0.0f ? 1.0f : -1.0f;
+        for (const glm::vec3& n : normals) {
+            minDot = std::min(minDot, glm::dot(n, m.coneAxis));
+        }
+        // past about 84 degrees the cone culls almost nothing.
+        m.coneCutoff = minDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    }
+
+    void build(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices,
+        uint32_t first, uint32_t count, std::vector<Meshlet>& meshlets)
+    {
+        const uint32_t* source = &indices[first];
+        uint32_t triangles = count / 3;
+        size_t vertexCount = positions.size();
+
+        // triangles around each vertex.
+        std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+        for (uint32_t i = 0; i < count; i++) {
+            adjacencyStart[source[i] + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyStart[v + 1] += adjacencyStart[v];
+        }
+        std::vector<uint32_t> adjacency(count);
+        std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (uint32_t i = 0; i < count; i++) {
+            adjacency[fill[source[i]]++] = i / 3;
+        }
+
+        std::vector<uint32_t> ordered;
+        ordered.reserve(count);
+        std::vector<bool> used(triangles, false);
+        // the meshlet a vertex or candidate triangle was last added to.
+        std::vector<uint32_t> vertexMeshlet(vertexCount, ~0u);
+        std::vector<uint32_t> candidateMeshlet(triangles, ~0u);
+        std::vector<uint32_t> candidates;
+
+        uint32_t seed = 0;
+        for (uint32_t id = 0; ; id++) {
+            while (seed < triangles && used[seed])
+                seed++;
+            if (seed == triangles)
+                break;
+
+            Meshlet m;
+            m.first = first + (uint32_t)ordered.size();
+            size_t vertices = 0, added = 0;
+            candidates.clear();
+
+            auto newVertices = [&](uint32_t t) {
+                size_t n = 0;
+                for (int c = 0; c < 3; c++) {
+                    n += vertexMeshlet[source[t * 3 + c]] != id;
+                }
+                return n;
+            };
+            auto addTriangle = [&](uint32_t t) {
+                used[t] = true;
+                added++;
+                for (int c = 0; c < 3; c++) {
+                    uint32_t v = source[t * 3 + c];
+                    ordered.push_back(v);
+                    if (vertexMeshlet[v] == id)
+                        continue;
+                    vertexMeshlet[v] = id;
+                    vertices++;
+                    for (uint32_t k = adjacencyStart[v]; k < adjacencyStart[v + 1]; k++) {
+                        uint32_t neighbour = adjacency[k];
+                        if (!used[neighbour] && candidateMeshlet[neighbour] != id) {
+                            candidateMeshlet[neighbour] = id;
+                            candidates.push_back(neighbour);
+                        }
+                    }
+                }
+            };
+
+            // grow over the neighbour adding the fewest vertices, so meshlets stay compact.
+            addTriangle(seed);
+            while (added < maxTriangles) {
+                size_t best = candidates.size(), bestNew = 4, write = 0;
+                for (size_t i = 0; i < candidates.size(); i++) {
+                    uint32_t t = candidates[i];
+                    if (used[t])
+                        continue;
+                    candidates[write] = t;
+                    size_t n = newVertices(t);
+                    if (n < bestNew) {
+                        best = write;
+                        bestNew = n;
+                    }
+                    write++;
+                }
+                candidates.resize(write);
+                if (best == candidates.size() || vertices + bestNew > maxVertices)
+                    break;
+                addTriangle(candidates[best]);
+            }
+
+            m.count = (uint32_t)(ordered.size() + first - m.first);
+            computeBounds(positions, &ordered[m.first - first], m);
+            meshlets.push_back(m);
+        }
+
+        std::copy(ordered.begin(), ordered.end(), indices.begin() + first);
+    }
+}
+
+MeshletCulling::MeshletCulling()
+    : threads(std::max(1u, std::thread::hardware_concurrency()))
+    , enabled(true)
+    , drawCount(0)
+    , meshletCount(0)
+    , visibleCount(0)
+{ }
+
+void MeshletCulling::clear()
+{
+    drawCount = 0;
+    meshletCount = 0;
+}
+
+uint32_t MeshletCulling::add(const Meshlet* meshlets, uint32_t count, const glm::mat4& model)
+{
+    if (drawCount == draws.size()) {
+        draws.emplace_back();
+    }
+    Draw& draw = draws[drawCount];
+    draw.meshlets = meshlets;
+    draw.count = count;
+    draw.model = model;
+    draw.offset = meshletCount;
+    meshletCount += count;
+    return (uint32_t)drawCount++;
+}
+
+void MeshletCulling::cull(Camera* camera)
+{
+    // the camera in each draw's object space: planes map by the transposed model.
+    for (size_t d = 0; d < drawCount; d++) {
+        Draw& draw = draws[d];
+        draw.eye = glm::vec3(glm::inverse(draw.model) * glm::vec4(camera->position, 1.0f));
+        for (int p = 0; p < 6; p++) {
+            glm::vec4 plane = glm::transpose(draw.model) * camera->frustum[p];
+            draw.planes[p] = plane / glm::length(glm::vec3(plane));
+        }
+        draw.cones = glm::determinant(glm::mat3(draw.model)) > 0.0f;
+    }
+
+    visible.resize(meshletCount);
+    size_t workers = std::min<size_t>(threads, std::max<size_t>(1, meshletCount / minMeshletsPerThread));
+    pool.run(workers, [&](size_t w) {
+        cullRange(meshletCount * w / workers, meshletCount * (w + 1) / workers);
+    });
+
+    visibleCount = 0;
+    for (size_t d = 0; d < drawCount; d++) {
+        Draw& draw = draws[d];
+        draw.ranges.clear();
+        for (uint32_t i = 0; i < draw.count; i++) {
+            if (visible[draw.offset + i]) {
+                draw.ranges.add(draw.meshlets[i].first, draw.meshlets[i].count);
+                visibleCount++;
+            }
+        }
+    }
+}
+
+void MeshletCulling::cullRange(size_t begin, size_t end)
+{
+    for (size_t d = 0; d < drawCount; d++) {
+        const Draw& draw = draws[d];
+        size_t from = std::max(begin, draw.offset), to = std::min(end, draw.offset + draw.count);
+        if (from >= to)
+            continue;
+        if (!enabled || draw.count < minMeshletsToCull) {
+            std::fill(visible.begin() + from, visible.begin() + to, 1);
+            continue;
+        }
+
+        for (size_t i = from; i < to; i++) {
+            const Meshlet& m = draw.meshlets[i - draw.offset];
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++) {
+                inside = glm::dot(glm::vec3(draw.planes[p]), m.center) + draw.planes[p].w >= -m.radius;
+            }
+            // backfacing: every triangle faces away from every point of the sphere as seen from the eye.
+            glm::vec3 view = m.center - draw.eye;
+            if (inside && draw.cones && glm::dot(view, m.coneAxis) >= m.coneCutoff * glm::length(view) + m.radius) {
+                inside = false;
+            }
+            visible[i] = inside;
+        }
+    }
+}
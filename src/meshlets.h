@@ -0,0 +1,84 @@
+#pragma once
+#include <glad.h>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "workerpool.h"
+
+class Camera;
+
+/* a cluster of up to Meshlets::maxVertices vertices and maxTriangles
+ * triangles, contiguous in the index buffer, with bounds in object space. */
+struct Meshlet {
+    uint32_t first;
+    uint32_t count;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis; // average triangle normal
+    float coneCutoff;   // sine of the normals' largest angle to the axis; 1 is never backfacing
+};
+
+/* index ranges for one glMultiDrawElements; ranges that follow each
+ * other in the index buffer are merged. */
+struct DrawRanges {
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+
+    void clear();
+    void add(uint32_t first, uint32_t count);
+};
+
+namespace Meshlets {
+    constexpr size_t maxVertices = 64;
+    constexpr size_t maxTriangles = 124;
+
+    /* reorders the triangles of indices[first, first + count) into meshlets,
+     * grown over shared vertices, and appends them. */
+    void build(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices,
+        uint32_t first, uint32_t count, std::vector<Meshlet>& meshlets);
+}
+
+/* Per-frame culling of meshlets against the frustum and by their normal
+ * cone. Draws are queued with add and culled together, spread over
+ * a WorkerPool; each draw gets the ranges of its surviving meshlets. The tests
+ * run in each draw's object space, so no bounds are transformed. */
+class MeshletCulling {
+public:
+    MeshletCulling();
+
+    void clear();
+    /* returns the index of the draw's ranges. */
+    uint32_t add(const Meshlet* meshlets, uint32_t count, const glm::mat4& model);
+    void cull(Camera* camera);
+    const DrawRanges& getRanges(uint32_t draw) { return draws[draw].ranges; }
+
+    void setThreads(unsigned threads) { this->threads = threads ? threads : 1; }
+    /* disabled, every meshlet survives and each draw is its whole range. */
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    size_t getMeshletCount() { return meshletCount; }
+    size_t getVisibleCount() { return visibleCount; }
+
+private:
+    struct Draw {
+        const Meshlet* meshlets;
+        uint32_t count;
+        glm::mat4 model;
+        size_t offset; // into visible
+        glm::vec3 eye;
+        glm::vec4 planes[6];
+        bool cones; // false when the model mirrors, which flips the winding
+        DrawRanges ranges;
+    };
+
+    void cullRange(size_t begin, size_t end);
+
+private:
+    unsigned threads;
+    bool enabled;
+    std::vector<Draw> draws; // kept across frames, with their ranges' storage
+    size_t drawCount;
+    std::vector<uint8_t> visible; // one per queued meshlet
+    size_t meshletCount;
+    size_t visibleCount;
+    WorkerPool pool;
+};
@@ -0,0 +1,225 @@
+#include "mipmap.h"
+
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+/* below this many output pixels per thread, spawning threads costs more than it saves. */
+constexpr size_t minPixelsPerThread = 65536;
+
+/* linear values are quantized to this many steps before sRGB encoding. */
+constexpr int encodeSteps = 4096;
+
+struct Tables {
+    float decode[256]; // sRGB byte to linear
+    float unorm[256];  // byte to [0, 1]
+    uint8_t encode[encodeSteps]; // linear to sRGB byte
+
+    Tables() {
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            decode[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            unorm[i] = c;
+        }
+        for (int i = 0; i < encodeSteps; i++) {
+            float l = i / float(encodeSteps - 1);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            encode[i] = (uint8_t)std::lround(c * 255.0f);
+        }
+    }
+};
+
+static const Tables& tables() {
+    static const Tables t;
+    return t;
+}
+
+/* one output pixel from the 2x2 block starting at column x0 of row0 and row1. */
+static void downsamplePixel(const uint8_t* row0, const uint8_t* row1, int x0, int x1, Mipmap::Kind kind, uint8_t* out)
+{
+    const Tables& t = tables();
+    const uint8_t* p[4] = { row0 + x0*4, row0 + x1*4, row1 + x0*4, row1 + x1*4 };
+
+    float sum[4] = {};
+    for (const uint8_t* q : p) {
+        for (int c = 0; c < 4; c++) {
+            if (kind == Mipmap::SRGB && c < 3) {
+                sum[c] += t.decode[q[c]];
+            } else if (kind == Mipmap::Normal && c < 3) {
+                sum[c] += t.unorm[q[c]] * 2.0f - 1.0f;
+            } else {
+                sum[c] += t.unorm[q[c]];
+            }
+        }
+    }
+
+    if (kind == Mipmap::Normal) {
+        float length = std::sqrt(sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2]);
+        float scale = length > 0 ? 1.0f / length : 0.0f;
+        for (int c = 0; c < 3; c++) {
+            out[c] = (uint8_t)std::lround((sum[c] * scale * 0.5f + 0.5f) * 255.0f);
+        }
+    } else if (kind == Mipmap::SRGB) {
+        for (int c = 0; c < 3; c++) {
+            out[c] = t.encode[std::lround(sum[c] * 0.25f * (encodeSteps - 1))];
+        }
+    } else {
+        for (int c = 0; c < 3; c++) {
+            out[c] = (uint8_t)std::lround(sum[c] * 0.25f * 255.0f);
+        }
+    }
+    out[3] = (uint8_t)std::lround(sum[3] * 0.25f * 255.0f);
+}
+
+#ifndef MIPMAP_SSE2
+/* sizes halve rounding down, so odd sizes drop the last row or column;
+ * a side of 1 reads its only row or column twice. */
+static void downsampleScalar(const Mipmap::Level& src, Mipmap::Level& dst, Mipmap::Kind kind, int rowBegin, int rowEnd)
+{
+    for (int y = rowBegin; y < rowEnd; y++) {
+        const uint8_t* row0 = &src.pixels[size_t(std::min(2*y, src.height - 1)) * src.width * 4];
+        const uint8_t* row1 = &src.pixels[size_t(std::min(2*y + 1, src.height - 1)) * src.width * 4];
+        uint8_t* out = &dst.pixels[size_t(y) * dst.width * 4];
+        for (int x = 0; x < dst.width; x++) {
+            downsamplePixel(row0, row1, std::min(2*x, src.width - 1), std::min(2*x + 1, src.width - 1), kind, out + x*4);
+        }
+    }
+}
+#endif
+
+#ifdef MIPMAP_SSE2
+static inline __m128 loadUnorm(const uint8_t* p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_cvtsi32_si128(p[0] | p[1] << 8 | p[2] << 16 | p[3] << 24);
+    v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+    return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / 255.0f));
+}
+
+static inline __m128 loadSRGB(const Tables& t, const uint8_t* p)
+{
+    return _mm_set_ps(t.unorm[p[3]], t.decode[p[2]], t.decode[p[1]], t.decode[p[0]]);
+}
+
+/* Linear: two output pixels per iteration in 16-bit integer lanes.
+ * SRGB and Normal: one output pixel per iteration, one channel per lane. */
+static void downsampleSSE2(const Mipmap::Level& src, Mipmap::Level& dst, Mipmap::Kind kind, int rowBegin, int rowEnd)
+{
+    const Tables& t = tables();
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 rgbMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    const __m128 encodeScale = _mm_set_ps(255.0f * 0.25f, (encodeSteps - 1) * 0.25f, (encodeSteps - 1) * 0.25f, (encodeSteps - 1) * 0.25f);
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        const uint8_t* row0 = &src.pixels[size_t(std::min(2*y, src.height - 1)) * src.width * 4];
+        const uint8_t* row1 = &src.pixels[size_t(std::min(2*y + 1, src.height - 1)) * src.width * 4];
+        uint8_t* out = &dst.pixels[size_t(y) * dst.width * 4];
+
+        int x = 0;
+        if (kind == Mipmap::Linear) {
+            for (; 2*x + 3 < src.width; x += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x*8));
+                __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x*8));
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                __m128i sum = _mm_unpacklo_epi64(lo, hi);
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+                _mm_storel_epi64((__m128i*)(out + x*4), _mm_packus_epi16(sum, sum));
+            }
+        } else {
+            for (; 2*x + 1 < src.width; x++) {
+                const uint8_t* p = row0 + x*8;
+                const uint8_t* q = row1 + x*8;
+                alignas(16) int32_t result[4];
+
+                if (kind == Mipmap::SRGB) {
+                    __m128 sum = _mm_add_ps(_mm_add_ps(loadSRGB(t, p), loadSRGB(t, p + 4)),
+                                            _mm_add_ps(loadSRGB(t, q), loadSRGB(t, q + 4)));
+                    _mm_store_si128((__m128i*)result, _mm_cvtps_epi32(_mm_mul_ps(sum, encodeScale)));
+                    for (int c = 0; c < 3; c++) {
+                        out[x*4 + c] = t.encode[result[c]];
+                    }
+                    out[x*4 + 3] = (uint8_t)result[3];
+                } else {
+                    __m128 sum = _mm_add_ps(_mm_add_ps(loadUnorm(p), loadUnorm(p + 4)),
+                                            _mm_add_ps(loadUnorm(q), loadUnorm(q + 4)));
+                    // rgb was stored as n * 0.5 + 0.5: the sum of 4 is sum(n) / 2 + 2.
+                    __m128 n = _mm_and_ps(_mm_sub_ps(sum, _mm_set1_ps(2.0f)), rgbMask);
+                    __m128 d = _mm_mul_ps(n, n);
+                    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+                    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+                    __m128 length = _mm_sqrt_ps(d);
+                    __m128 scale = _mm_and_ps(_mm_div_ps(half, length), _mm_cmpgt_ps(length, _mm_setzero_ps()));
+                    __m128 encoded = _mm_add_ps(_mm_mul_ps(n, scale), _mm_and_ps(half, rgbMask));
+                    // alpha is the plain average.
+                    encoded = _mm_or_ps(encoded, _mm_andnot_ps(rgbMask, _mm_mul_ps(sum, quarter)));
+                    __m128i bytes = _mm_cvtps_epi32(_mm_mul_ps(encoded, _mm_set1_ps(255.0f)));
+                    bytes = _mm_packs_epi32(bytes, bytes);
+                    bytes = _mm_packus_epi16(bytes, bytes);
+                    int packed = _mm_cvtsi128_si32(bytes);
+                    out[x*4 + 0] = (uint8_t)(packed);
+                    out[x*4 + 1] = (uint8_t)(packed >> 8);
+                    out[x*4 + 2] = (uint8_t)(packed >> 16);
+                    out[x*4 + 3] = (uint8_t)(packed >> 24);
+                }
+            }
+        }
+
+        // the remainder, and sources 1 texel wide.
+        for (; x < dst.width; x++) {
+            downsamplePixel(row0, row1, std::min(2*x, src.width - 1), std::min(2*x + 1, src.width - 1), kind, out + x*4);
+        }
+    }
+}
+#endif
+
+static void downsample(const Mipmap::Level& src, Mipmap::Level& dst, Mipmap::Kind kind, int rowBegin, int rowEnd)
+{
+#ifdef MIPMAP_SSE2
+    downsampleSSE2(src, dst, kind, rowBegin, rowEnd);
+#else
+    downsampleScalar(src, dst, kind, rowBegin, rowEnd);
+#endif
+}
+
+namespace Mipmap {
+    void generate(std::vector<Level>& levels, Kind kind) {
+        levels.resize(1);
+        tables();
+
+        while (levels.back().width > 1 || levels.back().height > 1) {
+            const Level& src = levels.back();
+            Level dst;
+            dst.width = std::max(1, src.width / 2);
+            dst.height = std::max(1, src.height / 2);
+            dst.pixels.resize(size_t(dst.width) * dst.height * 4);
+
+            // rows of a level are independent, each thread takes a band.
+            size_t pixels = size_t(dst.width) * dst.height;
+            size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), dst.height);
+            threads = std::max<size_t>(1, std::min(threads, pixels / minPixelsPerThread));
+
+            std::vector<std::thread> pool;
+            for (size_t i = 1; i < threads; i++) {
+                int begin = (int)(dst.height * i / threads);
+                int end = (int)(dst.height * (i + 1) / threads);
+                pool.emplace_back([&, begin, end] { downsample(src, dst, kind, begin, end); });
+            }
+            downsample(src, dst, kind, 0, (int)(dst.height / threads));
+            for (auto& thread : pool) {
+                thread.join();
+            }
+
+            levels.push_back(std::move(dst));
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+/* Mip chains for RGBA8 images, built on the CPU when a texture is first
+ * imported (and then kept in the TextureCache) instead of by the driver,
+ * so that each kind of map can be filtered correctly. Each level is a 2x2
+ * box filter of the one above it. */
+namespace Mipmap {
+    enum Kind : uint32_t {
+        Linear, // data such as metallic or roughness: averaged as stored
+        SRGB,   // color: averaged in linear space, alpha as stored
+        Normal, // tangent-space normals: averaged and renormalized
+    };
+
+    struct Level {
+        int width;
+        int height;
+        std::vector<uint8_t> pixels;
+    };
+
+    /* appends every level down to 1x1 after levels[0]. */
+    void generate(std::vector<Level>& levels, Kind kind);
+}
@@ -0,0 +1,64 @@
+#include "orm.h"
+#include "texturecache.h"
+
+#include <stb_image.h>
+
+#include <filesystem>
+#include <stdexcept>
+
+namespace ORM {
+    Mipmap::Level pack(const char* occlusion, const char* roughness, const char* metallic) {
+        if (!roughness) {
+            throw std::runtime_error("ORM::pack: no roughness map");
+        }
+        const char* paths[3] = { occlusion, roughness, metallic };
+        const uint8_t defaults[3] = { 255, 255, 0 };
+
+        Mipmap::Level level = {};
+        stbi_set_flip_vertically_on_load(true);
+        for (int c = 0; c < 3; c++) {
+            if (!paths[c])
+                continue;
+
+            int width, height, channels;
+            stbi_uc* pixels = stbi_load(paths[c], &width, &height, &channels, STBI_grey);
+            if (!pixels) {
+                throw std::runtime_error(paths[c]);
+            }
+            if (level.pixels.empty()) {
+                level.width = width;
+                level.height = height;
+                level.pixels.resize(size_t(width) * height * 4);
+                for (size_t i = 0; i < level.pixels.size(); i += 4) {
+                    level.pixels[i + 0] = defaults[0];
+                    level.pixels[i + 1] = defaults[1];
+                    level.pixels[i + 2] = defaults[2];
+                    level.pixels[i + 3] = 255;
+                }
+            } else if (width != level.width || height != level.height) {
+                stbi_image_free(pixels);
+                throw std::runtime_error(std::string(paths[c]) + ": size differs from the other material maps");
+            }
+
+            for (size_t i = 0; i < size_t(width) * height; i++) {
+                level.pixels[i * 4 + c] = pixels[i];
+            }
+            stbi_image_free(pixels);
+        }
+        return level;
+    }
+
+    uint64_t makeKey(const char* occlusion, const char* roughness, const char* metallic) {
+        const char* paths[3] = { occlusion, roughness, metallic };
+        uint64_t key = 0xcbf29ce484222325ull;
+        for (int c = 0; c < 3; c++) {
+            key = (key ^ (paths[c] ? TextureCache::makeKey(paths[c], "orm") : 0)) * 0x100000001b3ull;
+        }
+        return key;
+    }
+
+    std::string compressedPath(const char* roughness) {
+        std::filesystem::path path(roughness);
+        return path.replace_filename(path.stem().string() + "_orm.dds").string();
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include "mipmap.h"
+
+/* Packs a material's occlusion, roughness and metallic maps into the R, G
+ * and B channels of one texture (the glTF layout), so that shading takes
+ * one fetch and one sampler for all three. Roughness is required; missing
+ * occlusion is 1 and missing metallic 0. */
+namespace ORM {
+    /* the packed RGBA8 image; throws std::runtime_error if a map is missing or of another size. */
+    Mipmap::Level pack(const char* occlusion, const char* roughness, const char* metallic);
+    uint64_t makeKey(const char* occlusion, const char* roughness, const char* metallic);
+    /* where texconv writes the compressed packed map: next to the roughness map, as <name>_orm.dds. */
+    std::string compressedPath(const char* roughness);
+}
@@ -3,75 +3,216 @@
 #include "mesh.h"
 #include "skybox.h"
 #include "shaders.h"
+#include "texturemanager.h"
+#include "materialatlas.h"
 
-GLuint PBRRenderPass::program;
-GLuint PBRRenderPass::MVP_Location;
-GLuint PBRRenderPass::uModel_Location;
-GLuint PBRRenderPass::viewPos_Location;
-
-PBRRenderPass::PBRRenderPass() {
-    if (program == 0) {
-        linkProgram(&program,
-            Shaders::pbrVertexShader(),
-            Shaders::pbrFragmentShader());
-
-        glBindAttribLocation(program, 0, "aPosition");
-        glBindAttribLocation(program, 1, "aNormal");
-        glBindAttribLocation(program, 2, "aTexCoords");
-
-        glUseProgram(program);
-        glUniform1i(glGetUniformLocation(program, "albedoMap"), 0);
-        glUniform1i(glGetUniformLocation(program, "normalMap"), 1);
-        glUniform1i(glGetUniformLocation(program, "metallicMap"), 2);
-        glUniform1i(glGetUniformLocation(program, "roughnessMap"), 3);
-        glUniform1i(glGetUniformLocation(program, "irradianceMap"), 4);
-        glUniform1i(glGetUniformLocation(program, "prefilterMap"), 5);
-        glUniform1i(glGetUniformLocation(program, "brdflutMap"), 6);
-        MVP_Location = glGetUniformLocation(program, "MVP");
-        uModel_Location = glGetUniformLocation(program, "uModel");
-        viewPos_Location = glGetUniformLocation(program, "viewPos");
+PBRMaterial::PBRMaterial(const PBRMaterial& other)
+    : albedo(other.albedo)
+    , metallic(other.metallic)
+    , roughness(other.roughness)
+{
+    for (int i = 0; i < MapCount; i++) {
+        maps[i] = other.maps[i];
+        TextureManager::retain(maps[i]);
     }
 }
 
+PBRMaterial& PBRMaterial::operator=(const PBRMaterial& other) {
+    for (int i = 0; i < MapCount; i++) {
+        setMap((Map)i, other.maps[i]);
+    }
+    albedo = other.albedo;
+    metallic = other.metallic;
+    roughness = other.roughness;
+    return *this;
+}
+
+PBRMaterial::~PBRMaterial() {
+    for (GLuint map : maps) {
+        TextureManager::release(map);
+    }
+}
+
+void PBRMaterial::setMap(Map slot, GLuint map) {
+    // retain first, in case the map replaces itself.
+    TextureManager::retain(map);
+    TextureManager::release(maps[slot]);
+    maps[slot] = map;
+}
+
+void PBRMaterial::bind() {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, maps[Albedo]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, maps[Normal]);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, maps[ORM] != 0 ? maps[ORM] : maps[Metallic]);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, maps[Roughness]);
+}
+
+unsigned PBRMaterial::getVariant(bool vertexTangents) {
+    unsigned variant = 0;
+    if (maps[Normal] != 0)    variant |= Shaders::NormalMap;
+    if (maps[Normal] != 0 && vertexTangents) variant |= Shaders::VertexTangents;
+    if (maps[Albedo] == 0)    variant |= Shaders::ConstantAlbedo;
+    if (maps[ORM] != 0) {
+        variant |= Shaders::PackedORM;
+    } else {
+        if (maps[Metallic] == 0)  variant |= Shaders::ConstantMetallic;
+        if (maps[Roughness] == 0) variant |= Shaders::ConstantRoughness;
+    }
+    return variant;
+}
+
+PBRRenderPass::Program PBRRenderPass::programs[Shaders::QualityCount][Shaders::MaterialVariantCount];
+
+PBRRenderPass::PBRRenderPass() : lights(nullptr), quality(Shaders::High), impostors(false) {
+}
+
+void PBRRenderPass::prepare(PBRMaterial* material, bool vertexTangents) {
+    prepareVariant(material->getVariant(vertexTangents));
+}
+
+void PBRRenderPass::prepareAtlas() {
+    prepareVariant(MaterialAtlas::variant);
+    prepareVariant(MaterialAtlas::variant | Shaders::SphereImpostor);
+}
+
+void PBRRenderPass::prepareParametric() {
+    prepareVariant(Shaders::ParametricMaterial);
+    prepareVariant(Shaders::ParametricMaterial | Shaders::SphereImpostor);
+}
+
+void PBRRenderPass::prepareVariant(unsigned variant) {
+    Program& p = programs[quality][variant];
+    if (p.program.getId() != 0)
+        return;
+
+    GLuint vs = Shaders::pbrVertexShader();
+    if (variant & Shaders::SphereImpostor)
+        vs = Shaders::sphereImpostorVertexShader();
+    else if (variant & Shaders::InstancedVariants)
+        vs = Shaders::pbrInstancedVertexShader();
+
+    linkProgramAsync(&p.program, vs,
+        Shaders::pbrFragmentShader(variant, quality),
+        [&p] {
+            ShaderProgram& program = p.program;
+            program.use();
+            program.set(program.uniform("albedoMap"), 0);
+            program.set(program.uniform("normalMap"), 1);
+            program.set(program.uniform("metallicMap"), 2);
+            program.set(program.uniform("roughnessMap"), 3);
+            program.set(program.uniform("ormMap"), 2);
+            program.set(program.uniform("materialData"), 3);
+            program.set(program.uniform("irradianceMap"), 4);
+            program.set(program.uniform("prefilterMap"), 5);
+            program.set(program.uniform("brdflutMap"), 6);
+            p.MVP_Location = program.uniform("MVP");
+            p.viewProj_Location = program.uniform("uViewProj");
+            p.eye_Location = program.uniform("uEye");
+            p.uModel_Location = program.uniform("uModel");
+            p.viewPos_Location = program.uniform("viewPos");
+            p.albedo_Location = program.uniform("albedoConstant");
+            p.metallic_Location = program.uniform("metallicConstant");
+            p.roughness_Location = program.uniform("roughnessConstant");
+            p.lights_Locations = ClusteredLights::locate(program);
+        });
+}
+
+/* links the variant on first use unless prepare already did. */
+PBRRenderPass::Program& PBRRenderPass::useProgram(unsigned variant) {
+    prepareVariant(variant);
+    Program& p = programs[quality][variant];
+    finishProgram(&p.program);
+    p.program.use();
+    return p;
+}
+
 void PBRRenderPass::drawVAO(Camera* camera, int vao, int count, const glm::mat4& model, PBRMaterial* material, SkyboxMaterial* skybox) {
-    glUseProgram(program);
-    setupMatrix(camera, model);
-    useMaterial(material, skybox);
+    Program& p = useProgram(material->getVariant(false));
+    setupMatrix(p, camera, model);
+    useMaterial(p, material, skybox);
     glBindVertexArray(vao);
     glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0);
 }
 
-void PBRRenderPass::drawMesh(Camera* camera, Mesh* mesh, const glm::mat4& model, PBRMaterial* material, SkyboxMaterial* skybox) {
-    glUseProgram(program);
-    setupMatrix(camera, model);
-    useMaterial(material, skybox);
-    glBindVertexArray(mesh->getVAO());
-    glDrawElements(GL_TRIANGLES, mesh->getCount(), GL_UNSIGNED_INT, 0);
+void PBRRenderPass::drawMesh(Camera* camera, Mesh* mesh, const DrawRanges& ranges, const glm::mat4& model, PBRMaterial* material, SkyboxMaterial* skybox) {
+    Program& p = useProgram(material->getVariant(true));
+    setupMatrix(p, camera, model);
+    useMaterial(p, material, skybox);
+    mesh->draw(ranges);
 }
 
 void PBRRenderPass::drawSphere(Camera* camera, const glm::mat4& model, PBRMaterial* material, SkyboxMaterial* skybox) {
-    glUseProgram(program);
-    setupMatrix(camera, model);
-    useMaterial(material, skybox);
+    Program& p = useProgram(material->getVariant(true));
+    setupMatrix(p, camera, model);
+    useMaterial(p, material, skybox);
     renderSphere();
 }
 
-void PBRRenderPass::setupMatrix(Camera* camera, const glm::mat4& model) { 
-    glm::mat4 MVP = camera->projection * camera->view * model;
-    glUniformMatrix4fv(MVP_Location, 1, GL_FALSE, &MVP[0][0]);
-    glUniformMatrix4fv(uModel_Location, 1, GL_FALSE, &model[0][0]);
-    glUniform3fv(viewPos_Location, 1, &camera->position[0]);
+void PBRRenderPass::drawMeshInstanced(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count, MaterialAtlas* atlas, int batch, SkyboxMaterial* skybox) {
+    Program& p = useProgram(MaterialAtlas::variant);
+    useInstanced(p, camera, skybox);
+    atlas->bind(batch);
+    drawInstances(mesh->getVAO(), mesh->getLod(lod).count, mesh->getLod(lod).first, instances, count);
 }
 
-void PBRRenderPass::useMaterial(PBRMaterial* material, SkyboxMaterial* skybox) {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, material->getAlbedoMap());
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, material->getNormalMap());
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, material->getMetallicMap());
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, material->getRoughnessMap());
+void PBRRenderPass::drawSphereInstanced(Camera* camera, const Instance* instances, GLsizei count, MaterialAtlas* atlas, int batch, SkyboxMaterial* skybox) {
+    Program& p = useProgram(sphereVariant(MaterialAtlas::variant));
+    useInstanced(p, camera, skybox);
+    atlas->bind(batch);
+    drawSpheres(instances, count);
+}
+
+void PBRRenderPass::drawMeshParametric(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count, SkyboxMaterial* skybox) {
+    Program& p = useProgram(Shaders::ParametricMaterial);
+    useInstanced(p, camera, skybox);
+    drawInstances(mesh->getVAO(), mesh->getLod(lod).count, mesh->getLod(lod).first, instances, count);
+}
+
+void PBRRenderPass::drawSphereParametric(Camera* camera, const Instance* instances, GLsizei count, SkyboxMaterial* skybox) {
+    Program& p = useProgram(sphereVariant(Shaders::ParametricMaterial));
+    useInstanced(p, camera, skybox);
+    drawSpheres(instances, count);
+}
+
+unsigned PBRRenderPass::sphereVariant(unsigned variant) {
+    return impostors ? variant | Shaders::SphereImpostor : variant;
+}
+
+void PBRRenderPass::drawSpheres(const Instance* instances, GLsizei count) {
+    if (impostors) {
+        renderSphereImpostors(instances, count);
+    } else {
+        renderSphere(instances, count);
+    }
+}
+
+void PBRRenderPass::setupMatrix(Program& p, Camera* camera, const glm::mat4& model) {
+    p.program.set(p.MVP_Location, camera->projection * camera->view * model);
+    p.program.set(p.uModel_Location, model);
+    p.program.set(p.viewPos_Location, camera->position);
+}
+
+void PBRRenderPass::useMaterial(Program& p, PBRMaterial* material, SkyboxMaterial* skybox) {
+    material->bind();
+    p.program.set(p.albedo_Location, material->getAlbedo());
+    p.program.set(p.metallic_Location, material->getMetallic());
+    p.program.set(p.roughness_Location, material->getRoughness());
+    useEnvironment(p, skybox);
+}
+
+void PBRRenderPass::useInstanced(Program& p, Camera* camera, SkyboxMaterial* skybox) {
+    p.program.set(p.viewProj_Location, camera->projection * camera->view);
+    p.program.set(p.eye_Location, camera->position);
+    p.program.set(p.viewPos_Location, camera->position);
+    useEnvironment(p, skybox);
+}
+
+void PBRRenderPass::useEnvironment(Program& p, SkyboxMaterial* skybox) {
+    lights->bind(p.program, p.lights_Locations);
     glActiveTexture(GL_TEXTURE4);
     glBindTexture(GL_TEXTURE_CUBE_MAP, skybox->getIrradianceMap());
     glActiveTexture(GL_TEXTURE5);
@@ -2,52 +2,128 @@
 #include <glad.h>
 #include <glm/glm.hpp>
 #include "renderpass.h"
+#include "lights.h"
+#include "shaders.h"
 
+/* Holds a reference (TextureManager::retain) on each of its maps, so maps
+ * shared between materials live as long as one of them uses them. */
 class PBRMaterial
 {
 public:
     PBRMaterial()
-        : albedoMap(0)
-        , normalMap(0)
-        , metallicMap(0)
-        , roughnessMap(0)
+        : maps{}
+        , albedo(1.0f)
+        , metallic(0.0f)
+        , roughness(1.0f)
     { }
+    PBRMaterial(const PBRMaterial& other);
+    PBRMaterial& operator=(const PBRMaterial& other);
+    ~PBRMaterial();
 
-    void setAlbedoMap(GLuint map) { albedoMap = map; }
-    void setNormalMap(GLuint map) { normalMap = map; }
-    void setMetallicMap(GLuint map) { metallicMap = map; }
-    void setRoughnessMap(GLuint map) { roughnessMap = map; }
+    void setAlbedoMap(GLuint map) { setMap(Albedo, map); }
+    void setNormalMap(GLuint map) { setMap(Normal, map); }
+    void setMetallicMap(GLuint map) { setMap(Metallic, map); }
+    void setRoughnessMap(GLuint map) { setMap(Roughness, map); }
+    /* occlusion/roughness/metallic packed by RenderPass::loadORM; takes the
+     * place of the metallic and roughness maps and constants. */
+    void setORMMap(GLuint map) { setMap(ORM, map); }
 
-    GLuint getAlbedoMap() { return albedoMap; }
-    GLuint getNormalMap() { return normalMap; }
-    GLuint getMetallicMap() { return metallicMap; }
-    GLuint getRoughnessMap() { return roughnessMap; }
+    GLuint getAlbedoMap() { return maps[Albedo]; }
+    GLuint getNormalMap() { return maps[Normal]; }
+    GLuint getMetallicMap() { return maps[Metallic]; }
+    GLuint getRoughnessMap() { return maps[Roughness]; }
+    GLuint getORMMap() { return maps[ORM]; }
+
+    /* a channel without a map uses its constant instead. albedo is linear. */
+    void setAlbedo(const glm::vec3& color) { albedo = color; setMap(Albedo, 0); }
+    void setMetallic(float value) { metallic = value; setMap(Metallic, 0); }
+    void setRoughness(float value) { roughness = value; setMap(Roughness, 0); }
+
+    const glm::vec3& getAlbedo() { return albedo; }
+    float getMetallic() { return metallic; }
+    float getRoughness() { return roughness; }
+
+    /* Shaders::MaterialVariant bits of the shader this material needs, on
+     * geometry with or without a tangent attribute. */
+    unsigned getVariant(bool vertexTangents);
+
+    /* binds the maps to texture units 0-3; a packed ORM map goes in unit 2. */
+    void bind();
 
 private:
-    GLuint albedoMap;
-    GLuint normalMap;
-    GLuint metallicMap;
-    GLuint roughnessMap;
+    enum Map { Albedo, Normal, Metallic, Roughness, ORM, MapCount };
+
+    void setMap(Map slot, GLuint map);
+
+    GLuint maps[MapCount];
+
+    glm::vec3 albedo;
+    float metallic;
+    float roughness;
 };
 
 class Camera;
 class Mesh;
+struct DrawRanges;
 class SkyboxMaterial;
+class MaterialAtlas;
 
 class PBRRenderPass : public RenderPass {
 public:
     PBRRenderPass();
     void drawVAO(Camera* camera, int vao, int count, const glm::mat4& model, PBRMaterial* material, SkyboxMaterial* skybox);
-    void drawMesh(Camera* camera, Mesh* mesh, const glm::mat4& model, PBRMaterial* material, SkyboxMaterial* skybox);
+    void drawMesh(Camera* camera, Mesh* mesh, const DrawRanges& ranges, const glm::mat4& model, PBRMaterial* material, SkyboxMaterial* skybox);
     void drawSphere(Camera* camera, const glm::mat4& model, PBRMaterial* material, SkyboxMaterial* skybox);
+    /* all instances in one draw, whatever their materials, as long as they
+     * are in the atlas batch. */
+    void drawMeshInstanced(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count, MaterialAtlas* atlas, int batch, SkyboxMaterial* skybox);
+    void drawSphereInstanced(Camera* camera, const Instance* instances, GLsizei count, MaterialAtlas* atlas, int batch, SkyboxMaterial* skybox);
+    /* all instances in one draw, each with the albedo, metallic and roughness
+     * it carries; no material textures are bound. */
+    void drawMeshParametric(Camera* camera, Mesh* mesh, int lod, const Instance* instances, GLsizei count, SkyboxMaterial* skybox);
+    void drawSphereParametric(Camera* camera, const Instance* instances, GLsizei count, SkyboxMaterial* skybox);
+
+    void setLights(ClusteredLights* lights) { this->lights = lights; }
+
+    void setQuality(Shaders::Quality quality) { this->quality = quality; }
+    Shaders::Quality getQuality() { return quality; }
+
+    /* instanced spheres as ray-traced impostors instead of the tessellated mesh. */
+    void setSphereImpostors(bool impostors) { this->impostors = impostors; }
+
+    /* starts compiling the material's variant in the background. */
+    void prepare(PBRMaterial* material, bool vertexTangents = true);
+    /* the same for the instanced MaterialAtlas and ParametricMaterial variants. */
+    void prepareAtlas();
+    void prepareParametric();
 
 private:
-    void setupMatrix(Camera* camera, const glm::mat4& model);
-    void useMaterial(PBRMaterial* material, SkyboxMaterial* skybox);
+    struct Program {
+        ShaderProgram program;
+        ShaderProgram::Uniform MVP_Location;
+        ShaderProgram::Uniform viewProj_Location;
+        ShaderProgram::Uniform eye_Location;
+        ShaderProgram::Uniform uModel_Location;
+        ShaderProgram::Uniform viewPos_Location;
+        ShaderProgram::Uniform albedo_Location;
+        ShaderProgram::Uniform metallic_Location;
+        ShaderProgram::Uniform roughness_Location;
+        ClusteredLights::Locations lights_Locations;
+    };
+
+    void prepareVariant(unsigned variant);
+    Program& useProgram(unsigned variant);
+    void setupMatrix(Program& program, Camera* camera, const glm::mat4& model);
+    void useMaterial(Program& program, PBRMaterial* material, SkyboxMaterial* skybox);
+    void useInstanced(Program& program, Camera* camera, SkyboxMaterial* skybox);
+    unsigned sphereVariant(unsigned variant);
+    void drawSpheres(const Instance* instances, GLsizei count);
+    void useEnvironment(Program& program, SkyboxMaterial* skybox);
 
 private:
-    static GLuint program;
-    static GLuint MVP_Location;
-    static GLuint uModel_Location;
-    static GLuint viewPos_Location;
+    ClusteredLights* lights;
+    Shaders::Quality quality;
+    bool impostors;
+
+    static Program programs[Shaders::QualityCount][Shaders::MaterialVariantCount];
 };
@@ -0,0 +1,163 @@
+#include "program.h"
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+static uint32_t hashName(const char* name, size_t length) {
+    uint32_t hash = 0x811c9dc5u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 0x01000193u;
+    }
+    return hash;
+}
+
+/* shadow storage for one value of the given type, in 32-bit words. */
+static uint32_t typeWords(GLenum type) {
+    switch (type) {
+    case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: return 2;
+    case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: return 3;
+    case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_FLOAT_MAT2: return 4;
+    case GL_FLOAT_MAT3: return 9;
+    case GL_FLOAT_MAT4: return 16;
+    default: return 1; // scalars and samplers
+    }
+}
+
+template<typename T>
+static int find(const std::vector<T>& entries, const char* name) {
+    uint32_t hash = hashName(name, strlen(name));
+    auto it = std::lower_bound(entries.begin(), entries.end(), hash,
+        [](const T& entry, uint32_t hash) { return entry.hash < hash; });
+    if (it == entries.end() || it->hash != hash)
+        return -1;
+    return (int)(it - entries.begin());
+}
+
+template<typename T>
+static void sortByHash(std::vector<T>& entries) {
+    std::sort(entries.begin(), entries.end(), [](const T& a, const T& b) { return a.hash < b.hash; });
+    for (size_t i = 1; i < entries.size(); i++) {
+        if (entries[i].hash == entries[i-1].hash) {
+            throw std::runtime_error("ShaderProgram: name hash collision");
+        }
+    }
+}
+
+void ShaderProgram::reflect() {
+    uniforms.clear();
+    attributes.clear();
+    blocks.clear();
+    values.clear();
+
+    GLint count, maxLength;
+    std::vector<char> name;
+
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(id, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+        GLint location = glGetUniformLocation(id, name.data());
+        if (location < 0)
+            continue; // lives in a uniform block
+
+        // arrays are reported as "name[0]"; keep them addressable by their plain name.
+        if (length > 3 && strcmp(name.data() + length - 3, "[0]") == 0) {
+            length -= 3;
+        }
+
+        Entry entry = { hashName(name.data(), length), location, (uint32_t)values.size(), typeWords(type), false };
+        values.resize(values.size() + entry.size);
+        uniforms.push_back(entry);
+    }
+
+    glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(id, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+        Entry entry = { hashName(name.data(), length), glGetAttribLocation(id, name.data()), 0, 0, false };
+        attributes.push_back(entry);
+    }
+
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length;
+        glGetActiveUniformBlockName(id, i, (GLsizei)name.size(), &length, name.data());
+        Entry entry = { hashName(name.data(), length), i, 0, 0, false };
+        blocks.push_back(entry);
+    }
+
+    sortByHash(uniforms);
+    sortByHash(attributes);
+    sortByHash(blocks);
+}
+
+ShaderProgram::Uniform ShaderProgram::uniform(const char* name) const {
+    return find(uniforms, name);
+}
+
+GLint ShaderProgram::attribute(const char* name) const {
+    int i = find(attributes, name);
+    return i < 0 ? -1 : attributes[i].location;
+}
+
+GLint ShaderProgram::uniformBlock(const char* name) const {
+    int i = find(blocks, name);
+    return i < 0 ? -1 : blocks[i].location;
+}
+
+bool ShaderProgram::changed(Uniform uniform, const void* value, size_t size) {
+    if (uniform < 0)
+        return false;
+
+    Entry& entry = uniforms[uniform];
+    uint32_t* shadow = &values[entry.offset];
+    size = std::min<size_t>(size, entry.size * sizeof(uint32_t));
+    if (entry.valid && memcmp(shadow, value, size) == 0)
+        return false;
+
+    memcpy(shadow, value, size);
+    entry.valid = true;
+    return true;
+}
+
+void ShaderProgram::set(Uniform uniform, int value) {
+    if (changed(uniform, &value, sizeof(value)))
+        glUniform1i(uniforms[uniform].location, value);
+}
+
+void ShaderProgram::set(Uniform uniform, float value) {
+    if (changed(uniform, &value, sizeof(value)))
+        glUniform1f(uniforms[uniform].location, value);
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::vec2& value) {
+    if (changed(uniform, &value[0], sizeof(value)))
+        glUniform2fv(uniforms[uniform].location, 1, &value[0]);
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::vec3& value) {
+    if (changed(uniform, &value[0], sizeof(value)))
+        glUniform3fv(uniforms[uniform].location, 1, &value[0]);
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::ivec3& value) {
+    if (changed(uniform, &value[0], sizeof(value)))
+        glUniform3iv(uniforms[uniform].location, 1, &value[0]);
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::mat4& value) {
+    if (changed(uniform, &value[0][0], sizeof(value)))
+        glUniformMatrix4fv(uniforms[uniform].location, 1, GL_FALSE, &value[0][0]);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+/* A linked program and its reflection. After linking, the active uniforms,
+ * uniform blocks and attributes are read into small tables sorted by name
+ * hash, so lookups never reach the driver. Uniforms are addressed through
+ * the handle returned by uniform(); the typed setters keep a shadow copy
+ * of every value and skip the GL call when it has not changed. Setters
+ * write to the program that is current, as glUniform* does. */
+class ShaderProgram {
+public:
+    typedef int Uniform; // -1 for names the linker removed
+
+    ShaderProgram() : id(0) { }
+
+    GLuint getId() const { return id; }
+    void use() const { glUseProgram(id); }
+
+    Uniform uniform(const char* name) const;
+    GLint attribute(const char* name) const;
+    GLint uniformBlock(const char* name) const;
+
+    void set(Uniform uniform, int value);
+    void set(Uniform uniform, float value);
+    void set(Uniform uniform, const glm::vec2& value);
+    void set(Uniform uniform, const glm::vec3& value);
+    void set(Uniform uniform, const glm::ivec3& value);
+    void set(Uniform uniform, const glm::mat4& value);
+
+    /* reads the tables; RenderPass calls it once the link has finished. */
+    void reflect();
+
+private:
+    friend class RenderPass;
+    bool changed(Uniform uniform, const void* value, size_t size);
+
+    struct Entry {
+        uint32_t hash;
+        GLint location;
+        uint32_t offset; // into values, in words
+        uint32_t size;   // in words
+        bool valid;
+    };
+
+    GLuint id;
+    std::vector<Entry> uniforms;
+    std::vector<Entry> attributes;
+    std::vector<Entry> blocks;
+    std::vector<uint32_t> values;
+};
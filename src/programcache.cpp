@@ -0,0 +1,110 @@
+#include "programcache.h"
+#include "shaders.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+constexpr uint32_t cacheMagic = 0x50445242; // "BRDP"
+
+namespace ProgramCache {
+    std::string directory = "shadercache";
+
+    static bool isSupported() {
+        if (!GLAD_GL_ARB_get_program_binary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    static uint64_t hashString(uint64_t hash, const char* string) {
+        for (; string && *string; string++) {
+            hash = (hash ^ (unsigned char)*string) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    static std::string pathOf(uint64_t key) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+
+    void setDirectory(const char* path) {
+        directory = path;
+    }
+
+    uint64_t makeKey(GLuint vs, GLuint fs) {
+        static uint64_t driver = 0;
+        if (driver == 0) {
+            driver = 0xcbf29ce484222325ull;
+            driver = hashString(driver, (const char*)glGetString(GL_VENDOR));
+            driver = hashString(driver, (const char*)glGetString(GL_RENDERER));
+            driver = hashString(driver, (const char*)glGetString(GL_VERSION));
+        }
+
+        uint64_t key = driver;
+        key = (key ^ Shaders::getSourceHash(vs)) * 0x100000001b3ull;
+        key = (key ^ Shaders::getSourceHash(fs)) * 0x100000001b3ull;
+        return key;
+    }
+
+    bool load(GLuint program, uint64_t key) {
+        if (!isSupported())
+            return false;
+
+        std::ifstream file(pathOf(key), std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        uint64_t length = (uint64_t)file.tellg();
+        file.seekg(0);
+
+        // the declared size must be exactly what follows the header, so a corrupt entry cannot over-allocate.
+        uint32_t header[3];
+        if (length < sizeof(header) || !file.read((char*)header, sizeof(header)) || header[0] != cacheMagic)
+            return false;
+        if (header[2] == 0 || header[2] != length - sizeof(header))
+            return false;
+
+        std::vector<char> binary(header[2]);
+        if (!file.read(binary.data(), binary.size()))
+            return false;
+
+        glProgramBinary(program, header[1], binary.data(), (GLsizei)binary.size());
+
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        return status == GL_TRUE;
+    }
+
+    void store(GLuint program, uint64_t key) {
+        if (!isSupported())
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        std::ofstream file(pathOf(key), std::ios::binary);
+        uint32_t header[3] = { cacheMagic, format, (uint32_t)length };
+        file.write((const char*)header, sizeof(header));
+        file.write(binary.data(), length);
+    }
+
+    void prepare(GLuint program) {
+        if (isSupported()) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+    }
+}
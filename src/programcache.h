@@ -0,0 +1,19 @@
+#pragma once
+#include <glad.h>
+#include <cstdint>
+
+/* Disk cache of linked program binaries (GL_ARB_get_program_binary). The
+ * key covers both shaders' full sources, variant defines included, and the
+ * driver's vendor/renderer/version strings, so a driver update misses the
+ * cache instead of feeding it a stale binary. */
+namespace ProgramCache {
+    void setDirectory(const char* path);
+    uint64_t makeKey(GLuint vs, GLuint fs);
+
+    /* false when the entry is missing or the driver rejects it. */
+    bool load(GLuint program, uint64_t key);
+    void store(GLuint program, uint64_t key);
+
+    /* call before glLinkProgram so the driver keeps the binary around. */
+    void prepare(GLuint program);
+}
@@ -1,34 +1,222 @@
 #include "renderpass.h"
 #include "shaders.h"
+#include "programcache.h"
+#include "texturecache.h"
+#include "bc.h"
+#include "orm.h"
+#include "texturefile.h"
+#include "dds.h"
 
 #include <stb_image.h>
 #include <glm/glm.hpp>
 
 #include <vector>
 #include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <initializer_list>
 #include <stdexcept>
 
-void RenderPass::linkProgram(GLuint* program, GLuint vs, GLuint fs)
+struct PendingProgram {
+    ShaderProgram* program;
+    GLuint vs;
+    GLuint fs;
+    uint64_t key;
+    bool cached;
+    std::function<void()> onLinked;
+};
+
+static std::vector<PendingProgram> pendingPrograms;
+
+/* whether the driver can sample a format; the block-compressed ones outside core need an extension. */
+static bool canSample(GLenum internalFormat)
+{
+    switch (internalFormat) {
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return GLAD_GL_EXT_texture_compression_s3tc;
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        return GLAD_GL_EXT_texture_compression_s3tc && GLAD_GL_EXT_texture_sRGB;
+    case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB:
+    case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB:
+    case GL_COMPRESSED_RGBA_BPTC_UNORM_ARB:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB:
+        return GLAD_GL_ARB_texture_compression_bptc;
+    default:
+        return true;
+    }
+}
+
+/* reads back every level of a baked float cube map and stores it as BC6H. */
+static void storeCompressedCube(GLuint cubeMap, int size, int levels, const std::string& path)
+{
+    DDS::Image image;
+    image.format = DDS::BC6H;
+    image.width = size;
+    image.height = size;
+    image.levels = levels;
+    image.faces = 6;
+
+    std::vector<float> pixels(size_t(size) * size * 4);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    for (int face = 0; face < 6; face++) {
+        for (int level = 0; level < levels; level++) {
+            int levelSize = std::max(1, size >> level);
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA, GL_FLOAT, pixels.data());
+            std::vector<uint8_t> blocks = BC::compressHalf(pixels.data(), levelSize, levelSize);
+            image.data.insert(image.data.end(), blocks.begin(), blocks.end());
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    DDS::write(path.c_str(), image);
+}
+
+static void linkFromSource(GLuint program, GLuint vs, GLuint fs)
+{
+    Shaders::submitCompile(vs);
+    Shaders::submitCompile(fs);
+    ProgramCache::prepare(program);
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+}
+
+/* the first point that waits for the driver. */
+static void finalizeProgram(PendingProgram& pending)
+{
+    GLuint program = pending.program->getId();
+    if (!pending.cached) {
+        Shaders::checkCompile(pending.vs);
+        Shaders::checkCompile(pending.fs);
+
+        int length;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        if (length > 0) {
+            std::vector<char> message(length+1);
+            glGetProgramInfoLog(program, length, NULL, message.data());
+            throw std::runtime_error(std::string(message.data()));
+        }
+
+        glDetachShader(program, pending.fs);
+        glDetachShader(program, pending.vs);
+
+        ProgramCache::store(program, pending.key);
+    }
+
+    pending.program->reflect();
+    if (pending.onLinked) {
+        pending.onLinked();
+    }
+}
+
+void RenderPass::linkProgram(ShaderProgram* program, GLuint vs, GLuint fs)
+{
+    linkProgramAsync(program, vs, fs);
+    finishProgram(program);
+}
+
+void RenderPass::linkProgramAsync(ShaderProgram* program, GLuint vs, GLuint fs, std::function<void()> onLinked)
 {
-    *program = glCreateProgram();
-    glAttachShader(*program, vs);
-    glAttachShader(*program, fs);
-    glLinkProgram(*program);
+    program->id = glCreateProgram();
 
-    int length;
-    glGetProgramiv(*program, GL_INFO_LOG_LENGTH, &length);
-    if (length > 0) {
-        std::vector<char> message(length+1);
-        glGetProgramInfoLog(*program, length, NULL, message.data());
-        throw std::runtime_error(std::string(message.data()));
+    PendingProgram pending = { program, vs, fs, ProgramCache::makeKey(vs, fs), false, std::move(onLinked) };
+    pending.cached = ProgramCache::load(program->id, pending.key);
+    if (!pending.cached) {
+        linkFromSource(program->id, vs, fs);
     }
+    pendingPrograms.push_back(std::move(pending));
+}
 
-    glDetachShader(*program, fs);
-    glDetachShader(*program, vs);
+bool RenderPass::pollPrograms()
+{
+    // without the extension any status query would block, so leave them all to finishProgram.
+    if (!GLAD_GL_KHR_parallel_shader_compile)
+        return pendingPrograms.empty();
+
+    for (size_t i = 0; i < pendingPrograms.size(); ) {
+        GLint done = GL_TRUE;
+        if (!pendingPrograms[i].cached) {
+            glGetProgramiv(pendingPrograms[i].program->id, GL_COMPLETION_STATUS_KHR, &done);
+        }
+        if (done) {
+            PendingProgram pending = std::move(pendingPrograms[i]);
+            pendingPrograms.erase(pendingPrograms.begin() + i);
+            finalizeProgram(pending);
+        } else {
+            i++;
+        }
+    }
+    return pendingPrograms.empty();
+}
+
+void RenderPass::finishProgram(ShaderProgram* program)
+{
+    for (size_t i = 0; i < pendingPrograms.size(); i++) {
+        if (pendingPrograms[i].program == program) {
+            PendingProgram pending = std::move(pendingPrograms[i]);
+            pendingPrograms.erase(pendingPrograms.begin() + i);
+            finalizeProgram(pending);
+            return;
+        }
+    }
 }
 
 void RenderPass::bakeHDR(const char* path, GLuint* cubeMap, GLuint* irradianceMap, GLuint* prefilterMap)
 {
+    static ShaderProgram program;
+    static ShaderProgram convolution;
+    static ShaderProgram prefilter;
+    static ShaderProgram::Uniform face_Location;
+    static ShaderProgram::Uniform convolutionFace_Location;
+    static ShaderProgram::Uniform prefilterFace_Location;
+    static ShaderProgram::Uniform roughness_Location;
+    static GLuint vao;
+    static GLuint framebuffer;
+
+    // BC6H copies of the maps from an earlier bake; a warm start skips decoding and baking.
+    const char* variants[3] = { "cube", "irradiance", "prefilter" };
+    GLuint* maps[3] = { cubeMap, irradianceMap, prefilterMap };
+    std::string cached[3];
+    for (int i = 0; i < 3; i++) {
+        cached[i] = TextureCache::path(TextureCache::makeKey(path, variants[i]), ".dds");
+        *maps[i] = 0;
+    }
+    if (GLAD_GL_ARB_texture_compression_bptc) {
+        try {
+            for (int i = 0; i < 3; i++) {
+                *maps[i] = loadTextureFile(cached[i].c_str());
+            }
+            return;
+        } catch (const std::runtime_error&) {
+            // missing or damaged, so bake again below and overwrite them.
+            for (int i = 0; i < 3; i++) {
+                glDeleteTextures(1, maps[i]);
+            }
+        }
+    }
+
+    // the driver compiles these while the HDR is decoded below.
+    if (vao == 0) {
+        linkProgramAsync(&program, Shaders::bakehdrVertexShader(), Shaders::bakehdrFragmentShader(), [] {
+            face_Location = program.uniform("face");
+        });
+        linkProgramAsync(&convolution, Shaders::bakehdrVertexShader(), Shaders::bakehdrIrradianceConvolutionFragmentShader(), [] {
+            convolutionFace_Location = convolution.uniform("face");
+        });
+        linkProgramAsync(&prefilter, Shaders::bakehdrVertexShader(), Shaders::bakehdrPrefilterFragmentShader(), [] {
+            prefilterFace_Location = prefilter.uniform("face");
+            roughness_Location = prefilter.uniform("roughness");
+        });
+        glGenVertexArrays(1, &vao);
+        glGenFramebuffers(1, &framebuffer);
+    }
+
     int width, height, channels;
     stbi_set_flip_vertically_on_load(true);
     float* pixels = stbi_loadf(path, &width, &height, &channels, STBI_rgb);
@@ -89,20 +277,9 @@ void RenderPass::bakeHDR(const char* path, GLuint* cubeMap, GLuint* irradianceMa
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
-    static GLuint program = 0;
-    static GLuint convolution;
-    static GLuint prefilter;
-    static GLuint vao;
-
-    if (program == 0) {
-        linkProgram(&program, Shaders::bakehdrVertexShader(), Shaders::bakehdrFragmentShader());
-        linkProgram(&convolution, Shaders::bakehdrVertexShader(), Shaders::bakehdrIrradianceConvolutionFragmentShader());
-        linkProgram(&prefilter, Shaders::bakehdrVertexShader(), Shaders::bakehdrPrefilterFragmentShader());
-        glGenVertexArrays(1, &vao);
-    }
-
-    GLuint framebuffer;
-    glGenFramebuffers(1, &framebuffer);
+    finishProgram(&program);
+    finishProgram(&convolution);
+    finishProgram(&prefilter);
 
     GLint view[4];
     glGetIntegerv(GL_VIEWPORT, view);
@@ -112,9 +289,8 @@ void RenderPass::bakeHDR(const char* path, GLuint* cubeMap, GLuint* irradianceMa
         glViewport(0, 0, 512, 512);
         glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, *cubeMap, 0);
-        glUseProgram(program);
-        int face_Location = glGetUniformLocation(program, "face");
-        glUniform1i(face_Location, i);
+        program.use();
+        program.set(face_Location, i);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, hdr);
         glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -126,9 +302,8 @@ void RenderPass::bakeHDR(const char* path, GLuint* cubeMap, GLuint* irradianceMa
         glViewport(0, 0, 32, 32);
         glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, *irradianceMap, 0);
-        glUseProgram(convolution);
-        int face_Location = glGetUniformLocation(convolution, "face");
-        glUniform1i(face_Location, i);
+        convolution.use();
+        convolution.set(convolutionFace_Location, i);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, *cubeMap);
         glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -146,11 +321,9 @@ void RenderPass::bakeHDR(const char* path, GLuint* cubeMap, GLuint* irradianceMa
             glViewport(0, 0, mipWidth, mipHeight);
             glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, *prefilterMap, mip);
-            glUseProgram(prefilter);
-            int face_Location = glGetUniformLocation(prefilter, "face");
-            int roughness_Location = glGetUniformLocation(prefilter, "roughness");
-            glUniform1i(face_Location, i);
-            glUniform1f(roughness_Location, roughness);
+            prefilter.use();
+            prefilter.set(prefilterFace_Location, (int)i);
+            prefilter.set(roughness_Location, roughness);
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_CUBE_MAP, *cubeMap);
             glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -158,36 +331,113 @@ void RenderPass::bakeHDR(const char* path, GLuint* cubeMap, GLuint* irradianceMa
     }
 
     glViewport(view[0], view[1], view[2], view[3]);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    glDeleteFramebuffers(1, &framebuffer);
     glDeleteTextures(1, &hdr);
     stbi_image_free(pixels);
+
+    // swap the RGB16F maps for their BC6H encoding, a quarter of the memory.
+    if (GLAD_GL_ARB_texture_compression_bptc) {
+        const int sizes[3] = { 512, 32, 128 };
+        const int levels[3] = { 10, 1, (int)maxMipLevels };
+        try {
+            for (int i = 0; i < 3; i++) {
+                storeCompressedCube(*maps[i], sizes[i], levels[i], cached[i]);
+                glDeleteTextures(1, maps[i]);
+                *maps[i] = loadTextureFile(cached[i].c_str());
+            }
+        } catch (const std::runtime_error&) {
+            // an unwritable cache only means keeping the uncompressed maps.
+        }
+    }
 }
 
-void RenderPass::loadBRDFLUT(const char* path, GLuint* brdflutMap, int size)
+void RenderPass::loadBRDFLUT(const char* path, GLuint* brdflutMap)
 {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to load BRDF LUT");
+    *brdflutMap = loadTextureFile(path);
+    if (*brdflutMap == 0) {
+        throw std::runtime_error(std::string(path) + ": unsupported format");
     }
-
-    file.seekg(128); // skip header
-    char* data = new char[4*size*size];
-    file.read(data, 4*size*size);
-
-    glGenTextures(1, brdflutMap);
     glBindTexture(GL_TEXTURE_2D, *brdflutMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_HALF_FLOAT, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    delete[] data;
 }
 
 void RenderPass::renderSphere()
+{
+    GLsizei indexCount;
+    glBindVertexArray(sphere(&indexCount));
+    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+}
+
+void RenderPass::renderSphere(const Instance* instances, GLsizei count)
+{
+    GLsizei indexCount;
+    GLuint vao = sphere(&indexCount);
+    bindInstances(vao, instances, count);
+    glDrawElementsInstanced(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0, count);
+    unbindInstances();
+}
+
+void RenderPass::renderSphereImpostors(const Instance* instances, GLsizei count)
+{
+    // the corners come from gl_VertexID, so the vao only holds the instance attributes.
+    static GLuint impostorVAO = 0;
+    if (impostorVAO == 0) {
+        glGenVertexArrays(1, &impostorVAO);
+    }
+    bindInstances(impostorVAO, instances, count);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+}
+
+void RenderPass::drawInstances(GLuint vao, GLsizei indexCount, GLuint firstIndex, const Instance* instances, GLsizei count)
+{
+    bindInstances(vao, instances, count);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)(firstIndex * sizeof(uint32_t)), count);
+    unbindInstances();
+}
+
+/* re-pointing the attributes every draw is cheap and keeps any vao usable. */
+void RenderPass::bindInstances(GLuint vao, const Instance* instances, GLsizei count)
+{
+    static GLuint instanceBuffer = 0;
+    if (instanceBuffer == 0) {
+        glGenBuffers(1, &instanceBuffer);
+    }
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    // orphaned, so the upload does not wait for the previous draw.
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(Instance), instances, GL_STREAM_DRAW);
+    for (int column = 0; column < 4; column++) {
+        glEnableVertexAttribArray(4 + column);
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offsetof(Instance, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(4 + column, 1);
+    }
+    glEnableVertexAttribArray(8);
+    glVertexAttribIPointer(8, 1, GL_INT, sizeof(Instance), (void*)offsetof(Instance, material));
+    glVertexAttribDivisor(8, 1);
+    static_assert(offsetof(Instance, metallic) == offsetof(Instance, albedo) + sizeof(glm::vec3), "albedo and metallic are one vec4");
+    glEnableVertexAttribArray(9);
+    glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, albedo));
+    glVertexAttribDivisor(9, 1);
+    glEnableVertexAttribArray(10);
+    glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, roughness));
+    glVertexAttribDivisor(10, 1);
+}
+
+/* the sphere and mesh vaos are shared with plain draws, which must not see
+ * the instance attributes left enabled on them. */
+void RenderPass::unbindInstances()
+{
+    for (GLuint attribute = 4; attribute <= 10; attribute++) {
+        glDisableVertexAttribArray(attribute);
+    }
+}
+
+GLuint RenderPass::sphere(GLsizei* count)
 {
     static unsigned int sphereVAO = 0;
     static GLsizei indexCount;
@@ -203,6 +453,7 @@ void RenderPass::renderSphere()
         std::vector<glm::vec3> positions;
         std::vector<glm::vec2> uv;
         std::vector<glm::vec3> normals;
+        std::vector<glm::vec3> tangents;
         std::vector<unsigned int> indices;
 
         const unsigned int X_SEGMENTS = 64;
@@ -221,6 +472,8 @@ void RenderPass::renderSphere()
                 positions.push_back(glm::vec3(xPos, yPos, zPos));
                 uv.push_back(glm::vec2(xSegment, ySegment));
                 normals.push_back(glm::vec3(xPos, yPos, zPos));
+                // d(position)/du; the bitangent sign is +1 everywhere.
+                tangents.push_back(glm::vec3(-std::sin(xSegment * 2.0f * PI), 0.0f, std::cos(xSegment * 2.0f * PI)));
             }
         }
 
@@ -264,45 +517,217 @@ void RenderPass::renderSphere()
                 data.push_back(uv[i].x);
                 data.push_back(uv[i].y);
             }
+            data.push_back(tangents[i].x);
+            data.push_back(tangents[i].y);
+            data.push_back(tangents[i].z);
+            data.push_back(1.0f);
         }
         glBindVertexArray(sphereVAO);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-        unsigned int stride = (3 + 2 + 3) * sizeof(float);
+        unsigned int stride = (3 + 2 + 3 + 4) * sizeof(float);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(float)));
     }
 
-    glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+    *count = indexCount;
+    return sphereVAO;
 }
 
-GLuint RenderPass::loadTexture(const char* path)
+float RenderPass::anisotropy = 1.0f;
+
+void RenderPass::setAnisotropy(float anisotropy)
 {
-    int width, height, channels;
-    stbi_set_flip_vertically_on_load(true);
-    stbi_uc* pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+    float maxAnisotropy = 1.0f;
+    if (GLAD_GL_EXT_texture_filter_anisotropic) {
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+    }
+    RenderPass::anisotropy = std::min(std::max(anisotropy, 1.0f), maxAnisotropy);
+}
 
-    if (!pixels) {
-        throw std::runtime_error(path);
+GLuint RenderPass::createTexture(const TextureFile& file)
+{
+    if (!canSample(file.getInternalFormat()))
+        return 0;
+    if (file.getFaces() == 6 && file.getLayers() > 1)
+        throw std::runtime_error("cube map arrays are not supported");
+
+    GLenum target = file.getTarget();
+    bool cube = target == GL_TEXTURE_CUBE_MAP;
+    bool array = target == GL_TEXTURE_2D_ARRAY;
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, file.getAlignment());
+    for (int level = 0; level < file.getLevels(); level++) {
+        const TextureFile::Image& first = file.getImage(level);
+        if (array) {
+            // DDS keeps each layer's mip chain together, so the layers of a level go up one at a time.
+            if (file.isCompressed()) {
+                glCompressedTexImage3D(target, level, file.getInternalFormat(), first.width, first.height, file.getLayers(), 0,
+                    (GLsizei)(first.size * file.getLayers()), nullptr);
+            } else {
+                glTexImage3D(target, level, file.getInternalFormat(), first.width, first.height, file.getLayers(), 0,
+                    file.getFormat(), file.getType(), nullptr);
+            }
+            for (int layer = 0; layer < file.getLayers(); layer++) {
+                const TextureFile::Image& image = file.getImage(level, layer);
+                if (file.isCompressed()) {
+                    glCompressedTexSubImage3D(target, level, 0, 0, layer, image.width, image.height, 1,
+                        file.getInternalFormat(), (GLsizei)image.size, image.data);
+                } else {
+                    glTexSubImage3D(target, level, 0, 0, layer, image.width, image.height, 1,
+                        file.getFormat(), file.getType(), image.data);
+                }
+            }
+            continue;
+        }
+        for (int face = 0; face < file.getFaces(); face++) {
+            const TextureFile::Image& image = file.getImage(level, 0, face);
+            GLenum faceTarget = cube ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+            if (file.isCompressed()) {
+                glCompressedTexImage2D(faceTarget, level, file.getInternalFormat(), image.width, image.height, 0,
+                    (GLsizei)image.size, image.data);
+            } else {
+                glTexImage2D(faceTarget, level, file.getInternalFormat(), image.width, image.height, 0,
+                    file.getFormat(), file.getType(), image.data);
+            }
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, file.getLevels() - 1);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, file.getLevels() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (cube) {
+        glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        if (anisotropy > 1.0f) {
+            glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+        }
     }
 
+    return texture;
+}
+
+/* a prebaked file counts only when it exists and no source is newer; missing
+ * sources (null, or not shipped) do not invalidate it. */
+static bool isPrebaked(const std::string& prebaked, std::initializer_list<const char*> sources)
+{
+    std::error_code error;
+    auto baked = std::filesystem::last_write_time(prebaked, error);
+    if (error)
+        return false;
+    for (const char* source : sources) {
+        if (!source)
+            continue;
+        auto time = std::filesystem::last_write_time(source, error);
+        if (!error && time > baked)
+            return false;
+    }
+    return true;
+}
+
+GLuint RenderPass::loadTextureFile(const char* path, GLenum* target)
+{
+    TextureFile file(path);
+    if (target) {
+        *target = file.getTarget();
+    }
+    return createTexture(file);
+}
+
+GLuint RenderPass::loadTexture(const char* path, Mipmap::Kind kind, GLenum* target)
+{
+    for (const char* extension : { ".ktx2", ".ktx", ".dds" }) {
+        std::string prebaked = std::filesystem::path(path).replace_extension(extension).string();
+        if (isPrebaked(prebaked, { path })) {
+            GLuint texture = loadTextureFile(prebaked.c_str(), target);
+            if (texture)
+                return texture;
+        }
+    }
+
+    if (target) {
+        *target = GL_TEXTURE_2D;
+    }
+    uint64_t key = TextureCache::makeKey(path, kind);
+    std::vector<Mipmap::Level> levels;
+    if (!TextureCache::load(key, levels)) {
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(true);
+        stbi_uc* pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+
+        if (!pixels) {
+            throw std::runtime_error(path);
+        }
+
+        levels.resize(1);
+        levels[0].width = width;
+        levels[0].height = height;
+        levels[0].pixels.assign(pixels, pixels + size_t(width) * height * 4);
+        stbi_image_free(pixels);
+
+        Mipmap::generate(levels, kind);
+        TextureCache::store(key, levels);
+    }
+
+    // color maps are sRGB-encoded and decoded by the sampler, data maps are linear.
+    return createTexture(levels, kind == Mipmap::SRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+}
+
+GLuint RenderPass::loadORM(const char* occlusion, const char* roughness, const char* metallic, GLenum* target)
+{
+    std::string compressed = ORM::compressedPath(roughness);
+    if (isPrebaked(compressed, { occlusion, roughness, metallic })) {
+        GLuint texture = loadTextureFile(compressed.c_str(), target);
+        if (texture)
+            return texture;
+    }
+
+    if (target) {
+        *target = GL_TEXTURE_2D;
+    }
+    uint64_t key = ORM::makeKey(occlusion, roughness, metallic);
+    std::vector<Mipmap::Level> levels;
+    if (!TextureCache::load(key, levels)) {
+        levels.assign(1, ORM::pack(occlusion, roughness, metallic));
+        Mipmap::generate(levels, Mipmap::Linear);
+        TextureCache::store(key, levels);
+    }
+    return createTexture(levels, GL_RGBA8);
+}
+
+GLuint RenderPass::createTexture(const std::vector<Mipmap::Level>& levels, GLenum format)
+{
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (size_t i = 0; i < levels.size(); i++) {
+        glTexImage2D(GL_TEXTURE_2D, (GLint)i, format, levels[i].width, levels[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, levels[i].pixels.data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    stbi_image_free(pixels);
+    if (anisotropy > 1.0f) {
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+    }
 
     return texture;
 }
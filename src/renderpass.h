@@ -1,12 +1,65 @@
 #pragma once
 #include <glad.h>
+#include <functional>
+#include "program.h"
+#include "mipmap.h"
+
+class TextureFile;
 
 class RenderPass {
 public:
-    static void linkProgram(GLuint* program, GLuint vs, GLuint fs);
+    /* per-instance attributes of the instanced shaders: the model matrix at
+     * locations 4-7, the MaterialAtlas material index at 8, and the material
+     * of the ParametricMaterial variant at 9 (albedo, metallic) and 10. */
+    struct Instance {
+        glm::mat4 model;
+        int32_t material = -1;
+        glm::vec3 albedo = glm::vec3(1.0f); // linear
+        float metallic = 0.0f;
+        float roughness = 1.0f;
+    };
+
+    static void linkProgram(ShaderProgram* program, GLuint vs, GLuint fs);
+
+    /* Submits the compile and link without waiting for the driver; onLinked
+     * runs once the program is finished and reflected. pollPrograms
+     * finishes the ones the driver reports complete (only with
+     * KHR_parallel_shader_compile) and finishProgram, called before a
+     * program's first use, waits. */
+    static void linkProgramAsync(ShaderProgram* program, GLuint vs, GLuint fs, std::function<void()> onLinked = nullptr);
+    static bool pollPrograms();
+    static void finishProgram(ShaderProgram* program);
+
     static void bakeHDR(const char* path, GLuint* cubeMap, GLuint* irradianceMap, GLuint* prefilterMap);
-    static void loadBRDFLUT(const char* path, GLuint* brdflutMap, int size = 512);
+    /* any two-channel LUT TextureFile reads; its size is taken from the file. */
+    static void loadBRDFLUT(const char* path, GLuint* brdflutMap);
     static void renderSphere();
-    static GLuint loadTexture(const char* path);
+    static void renderSphere(const Instance* instances, GLsizei count);
+    /* four vertices per sphere, for the SphereImpostor variants. */
+    static void renderSphereImpostors(const Instance* instances, GLsizei count);
+    /* one instanced glDrawElements of indexCount indices from firstIndex, the
+     * instances streamed through a buffer shared by all instanced draws. */
+    static void drawInstances(GLuint vao, GLsizei indexCount, GLuint firstIndex, const Instance* instances, GLsizei count);
+    /* loads with a full mip chain from the TextureCache, building and storing it on a miss.
+     * A prebaked sibling (same name, .ktx2, .ktx or .dds), e.g. from texconv, takes precedence,
+     * so the texture may be an array or a cube map; target, if given, receives which. */
+    static GLuint loadTexture(const char* path, Mipmap::Kind kind = Mipmap::Linear, GLenum* target = nullptr);
+    /* a DDS or KTX file, uploaded straight from its mapping (see TextureFile).
+     * 0 when the driver cannot sample the file's format. */
+    static GLuint loadTextureFile(const char* path, GLenum* target = nullptr);
+    /* packs the maps into one texture (see ORM), cached like loadTexture;
+     * occlusion and metallic may be null. texconv's <roughness>_orm.dds takes precedence. */
+    static GLuint loadORM(const char* occlusion, const char* roughness, const char* metallic, GLenum* target = nullptr);
+    /* for textures loaded afterwards; clamped to what the driver supports. */
+    static void setAnisotropy(float anisotropy);
     static GLuint makeTexture(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+
+private:
+    static void bindInstances(GLuint vao, const Instance* instances, GLsizei count);
+    static void unbindInstances();
+    static GLuint sphere(GLsizei* indexCount);
+    static GLuint createTexture(const TextureFile& file);
+    static GLuint createTexture(const std::vector<Mipmap::Level>& levels, GLenum format);
+
+    static float anisotropy;
 };
@@ -0,0 +1,39 @@
+#include "resolution.h"
+
+#include <cmath>
+#include <algorithm>
+
+/* frame times in [deadBand * target, target] leave the scale alone. */
+constexpr float deadBand = 0.85f;
+/* fraction of the way to the ideal scale taken per frame. */
+constexpr float rate = 0.05f;
+
+ResolutionScaler::ResolutionScaler()
+    : target(1000.0f / 60)
+    , minScale(0.5f)
+    , maxScale(1.0f)
+    , scale(1.0f)
+{ }
+
+void ResolutionScaler::setRange(float minScale, float maxScale) {
+    this->minScale = minScale;
+    this->maxScale = maxScale;
+    scale = std::min(std::max(scale, minScale), maxScale);
+}
+
+void ResolutionScaler::update(float milliseconds) {
+    if (milliseconds <= 0 || (milliseconds >= deadBand * target && milliseconds <= target))
+        return;
+
+    // aim for the middle of the band.
+    float ideal = scale * std::sqrt((1.0f + deadBand) * 0.5f * target / milliseconds);
+    scale += (ideal - scale) * rate;
+    scale = std::min(std::max(scale, minScale), maxScale);
+}
+
+void ResolutionScaler::getSize(int width, int height, int* scaledWidth, int* scaledHeight) {
+    *scaledWidth = std::max(8, (int)std::lround(width * scale / 8) * 8);
+    *scaledHeight = std::max(8, (int)std::lround(height * scale / 8) * 8);
+    *scaledWidth = std::min(*scaledWidth, width);
+    *scaledHeight = std::min(*scaledHeight, height);
+}
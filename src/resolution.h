@@ -0,0 +1,27 @@
+#pragma once
+
+/* Chooses the fraction of the output resolution to render at so that the
+ * measured GPU frame time stays under a target. Shading cost scales with
+ * the pixel count, i.e. with scale squared. The scale moves slowly and
+ * only outside a dead band, because the timings it reacts to are smoothed
+ * and lag a few frames, and every new size allocates new targets. */
+class ResolutionScaler {
+public:
+    ResolutionScaler();
+
+    void setTarget(float milliseconds) { target = milliseconds; }
+    void setRange(float minScale, float maxScale);
+    void reset() { scale = maxScale; }
+
+    void update(float milliseconds);
+
+    float getScale() { return scale; }
+    /* the render size, rounded to a multiple of 8 so small corrections don't reallocate. */
+    void getSize(int width, int height, int* scaledWidth, int* scaledHeight);
+
+private:
+    float target;
+    float minScale;
+    float maxScale;
+    float scale;
+};
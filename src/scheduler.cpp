@@ -0,0 +1,97 @@
+#include "scheduler.h"
+
+PassScheduler::PassScheduler()
+    : skyOrder(SkyLast)
+    , depthPrepass(true)
+{ }
+
+void PassScheduler::add(Stage stage, const char* name,
+    std::function<void(FrameGraph::Builder&)> setup,
+    std::function<void()> execute)
+{
+    passes.emplace_back(new Pass());
+    Pass* pass = passes.back().get();
+    pass->stage = stage;
+    pass->executed = false;
+    pass->execute = std::move(execute);
+    pass->node.name = name;
+    pass->node.setup = std::move(setup);
+    pass->node.execute = [this, pass] {
+        beginStage(pass->stage);
+        pass->timer.begin();
+        pass->execute();
+        pass->timer.end();
+        pass->executed = true;
+        endStage();
+    };
+}
+
+void PassScheduler::beginFrame(int width, int height) {
+    graph.beginFrame();
+    graph.importBackbuffer("backbuffer", width, height);
+    for (auto& pass : passes) {
+        pass->executed = false;
+    }
+}
+
+void PassScheduler::execute() {
+    if (skyOrder == SkyFirst) {
+        addStage(Sky);
+    }
+    if (depthPrepass) {
+        addStage(Depth);
+    }
+    addStage(Opaque);
+    addStage(Lighting);
+    if (skyOrder == SkyLast) {
+        addStage(Sky);
+    }
+    addStage(Post);
+
+    graph.compile();
+    graph.execute();
+}
+
+void PassScheduler::addStage(Stage stage) {
+    for (auto& pass : passes) {
+        if (pass->stage == stage)
+            graph.addPass(&pass->node);
+    }
+}
+
+void PassScheduler::beginStage(Stage stage) {
+    switch (stage) {
+    case Depth:
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        break;
+    case Opaque:
+        if (depthPrepass) {
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_LEQUAL);
+        }
+        break;
+    case Lighting:
+        // full-screen passes that write the depth they resolve from their inputs.
+        glDepthFunc(GL_ALWAYS);
+        break;
+    case Sky:
+        // the sky is drawn at the far plane and must pass against the cleared depth.
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+        break;
+    case Post:
+        // full-screen passes over finished images.
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_ALWAYS);
+        break;
+    default:
+        break;
+    }
+}
+
+void PassScheduler::endStage() {
+    // back to the default state for the next pass.
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include "framegraph.h"
+#include "timer.h"
+
+/* Owns the order in which the frame's passes run and the depth state each
+ * stage runs with. Passes are registered once per stage; every frame they
+ * are added to the frame graph in stage order, which decides their targets.
+ * Shared targets are created on the graph between beginFrame() and
+ * execute(). Each pass is timed on the GPU. */
+class PassScheduler {
+public:
+    enum Stage {
+        Depth,
+        Opaque,
+        Lighting,
+        Sky,
+        Post,
+        StageCount
+    };
+
+    enum SkyOrder {
+        SkyFirst, // sky shades every pixel, geometry is drawn over it
+        SkyLast,  // sky is drawn at the far plane, covered pixels fail early-Z
+    };
+
+    PassScheduler();
+
+    void add(Stage stage, const char* name,
+        std::function<void(FrameGraph::Builder&)> setup,
+        std::function<void()> execute);
+    void beginFrame(int width, int height);
+    void execute();
+
+    void setSkyOrder(SkyOrder order) { skyOrder = order; }
+    SkyOrder getSkyOrder() { return skyOrder; }
+    void setDepthPrepass(bool enable) { depthPrepass = enable; }
+    bool getDepthPrepass() { return depthPrepass; }
+
+    FrameGraph& getGraph() { return graph; }
+
+    size_t getPassCount() { return passes.size(); }
+    const char* getPassName(size_t i) { return passes[i]->node.name; }
+    float getMilliseconds(size_t i) { return passes[i]->timer.getMilliseconds(); }
+    bool wasExecuted(size_t i) { return passes[i]->executed; }
+
+private:
+    struct Pass {
+        Stage stage;
+        FrameGraph::Pass node;
+        std::function<void()> execute;
+        GPUTimer timer;
+        bool executed;
+    };
+
+    void addStage(Stage stage);
+    void beginStage(Stage stage);
+    void endStage();
+
+private:
+    SkyOrder skyOrder;
+    bool depthPrepass;
+    FrameGraph graph;
+    std::vector<std::unique_ptr<Pass>> passes;
+};
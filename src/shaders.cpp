@@ -2,71 +2,341 @@
 #include <string>
 #include <vector>
 #include <stdexcept>
+#include <unordered_map>
+#include <initializer_list>
+
+constexpr const char* version_source = "#version 330 core\n";
+
+struct ShaderState {
+    uint64_t hash;
+    bool submitted;
+    bool checked;
+};
+
+/* shaders are only compiled when a link misses the program cache. */
+static std::unordered_map<GLuint, ShaderState> shaderStates;
+
+static uint64_t hashSource(uint64_t hash, const char* source) {
+    for (; *source; source++) {
+        hash = (hash ^ (unsigned char)*source) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/* the sources are concatenated after the #version line, in order. */
+GLuint createShader(GLenum type, std::initializer_list<const char*> sources) {
+    std::vector<const char*> strings = { version_source };
+    strings.insert(strings.end(), sources.begin(), sources.end());
 
-GLuint compileShader(GLenum type, const char* source) {
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
-    glCompileShader(shader);
+    glShaderSource(shader, (GLsizei)strings.size(), strings.data(), NULL);
 
-    int length;
-    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-    if (length > 0) {
-        std::vector<char> message(length+1);
-        glGetShaderInfoLog(shader, length, NULL, message.data());
-        throw std::runtime_error(std::string(message.data()));
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char* string : strings) {
+        hash = hashSource(hash, string);
     }
+    shaderStates[shader] = { hash, false, false };
 
     return shader;
 }
 
 constexpr const char* pbr_vert_source =
-R"( #version 330 core
+R"(
 
-    in vec3 aPosition;
-    in vec3 aNormal;
-    in vec2 aTexCoords;
+    layout(location = 0) in vec3 aPosition;
+    layout(location = 1) in vec3 aNormal;
+    layout(location = 2) in vec2 aTexCoords;
+    layout(location = 3) in vec4 aTangent;
 
     out vec3 WorldPos;
     out vec3 Normal;
     out vec2 TexCoords;
+    out vec4 Tangent;
+
+#ifdef INSTANCED
+    layout(location = 4) in mat4 aModel;
+    layout(location = 8) in int aMaterial;
+    layout(location = 9) in vec4 aAlbedoMetallic;
+    layout(location = 10) in float aRoughness;
 
+    flat out int MaterialIndex;
+    flat out vec4 InstanceAlbedoMetallic;
+    flat out float InstanceRoughness;
+
+    uniform mat4 uViewProj;
+#else
     uniform mat4 MVP;
     uniform mat4 uModel;
+#endif
+
+    invariant gl_Position;
 
     void main() {
+#ifdef INSTANCED
+        mat4 uModel = aModel;
+        gl_Position = uViewProj * (aModel * vec4(aPosition, 1.0));
+        MaterialIndex = aMaterial;
+        InstanceAlbedoMetallic = aAlbedoMetallic;
+        InstanceRoughness = aRoughness;
+#else
         gl_Position = MVP * vec4(aPosition, 1.0);
+#endif
         WorldPos = vec3(uModel * vec4(aPosition, 1));
         Normal = mat3(uModel) * aNormal;
         TexCoords = aTexCoords;
+        Tangent = vec4(mat3(uModel) * aTangent.xyz, aTangent.w);
     }
 )";
-constexpr const char* pbr_frag_source =
-R"( #version 330 core
+constexpr const char* sphere_impostor_vert_source =
+R"(
+    layout(location = 4) in mat4 aModel;
+    layout(location = 8) in int aMaterial;
+    layout(location = 9) in vec4 aAlbedoMetallic;
+    layout(location = 10) in float aRoughness;
+
+    out vec3 ImpostorRay;
+    flat out vec3 ImpostorEye;
+    flat out vec4 ImpostorSphere;
+    flat out int MaterialIndex;
+    flat out vec4 InstanceAlbedoMetallic;
+    flat out float InstanceRoughness;
+
+    uniform mat4 uViewProj;
+    uniform vec3 uEye;
 
+    void main() {
+        vec3 center = aModel[3].xyz;
+        float radius = length(aModel[0].xyz);
+        vec3 toEye = uEye - center;
+        vec3 forward = normalize(toEye);
+        vec3 up = abs(forward.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+        vec3 right = normalize(cross(up, forward));
+        up = cross(forward, right);
+
+        // facing the eye and touching the front of the sphere: a square of half
+        // size radius there covers the silhouette, and every ray reaches the
+        // quad before the sphere, which is what depth_greater promises.
+        vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+        vec3 position = center + (forward + right * corner.x + up * corner.y) * radius;
+        gl_Position = uViewProj * vec4(position, 1.0);
+
+        ImpostorRay = position - uEye;
+        ImpostorEye = toEye;
+        ImpostorSphere = vec4(center, radius);
+        MaterialIndex = aMaterial;
+        InstanceAlbedoMetallic = aAlbedoMetallic;
+        InstanceRoughness = aRoughness;
+    }
+)";
+constexpr const char* sphere_impostor_source =
+R"(
+#ifdef SPHERE_IMPOSTOR
+#ifdef GL_ARB_conservative_depth
+#extension GL_ARB_conservative_depth : enable
+    // keeps early depth testing against the quad, which is never behind the sphere.
+    layout(depth_greater) out float gl_FragDepth;
+#endif
+    in vec3 ImpostorRay;
+    flat in vec3 ImpostorEye; // relative to the center
+    flat in vec4 ImpostorSphere;
+
+    uniform mat4 uViewProj;
+
+    // what the vertex shader passes for a tessellated sphere, set by traceImpostor.
+    vec3 WorldPos;
+    vec3 Normal;
+    vec2 TexCoords;
+    vec4 Tangent;
+    // explicit gradients of TexCoords for sampling, see traceImpostor.
+    vec2 TexCoordsDx;
+    vec2 TexCoordsDy;
+
+    // the nearest hit of the sphere, parameterized like RenderPass::renderSphere.
+    void traceImpostor()
+    {
+        vec3 d = normalize(ImpostorRay);
+        float r = ImpostorSphere.w;
+        float b = dot(ImpostorEye, d);
+        float h = b * b - dot(ImpostorEye, ImpostorEye) + r * r;
+        if (h < 0.0)
+            discard;
+        vec3 local = ImpostorEye + (-b - sqrt(h)) * d;
+
+        WorldPos = ImpostorSphere.xyz + local;
+        Normal = local / r;
+        float phi = atan(Normal.z, Normal.x);
+        TexCoords = vec2(fract(phi * 0.15915494), acos(clamp(Normal.y, -1.0, 1.0)) * 0.31830989);
+        Tangent = vec4(-sin(phi), 0.0, cos(phi), 1.0);
+
+        // u jumps from 1 to 0 at phi = +-pi, where its implicit derivatives would pick
+        // the smallest mip; the copy wrapped half a turn away is smooth there instead.
+        vec2 u = vec2(TexCoords.x, fract(TexCoords.x + 0.5));
+        vec2 ux = dFdx(u), uy = dFdy(u);
+        TexCoordsDx = vec2(abs(ux.x) < abs(ux.y) ? ux.x : ux.y, dFdx(TexCoords.y));
+        TexCoordsDy = vec2(abs(uy.x) < abs(uy.y) ? uy.x : uy.y, dFdy(TexCoords.y));
+
+        vec4 clip = uViewProj * vec4(WorldPos, 1.0);
+        gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+    }
+#endif
+)";
+constexpr const char* pbr_material_source =
+R"(
+#ifndef SPHERE_IMPOSTOR
     in vec3 WorldPos;
     in vec3 Normal;
     in vec2 TexCoords;
+#ifdef VERTEX_TANGENTS
+    in vec4 Tangent;
+#endif
+#endif
 
-    out vec4 FragColor;
+#if defined(PARAMETRIC_MATERIAL)
+    // the whole material comes with the instance (RenderPass::Instance), no maps are bound.
+    flat in vec4 InstanceAlbedoMetallic;
+    flat in float InstanceRoughness;
+
+    vec3 materialcolor()
+    {
+        return InstanceAlbedoMetallic.rgb;
+    }
+
+    vec3 materialorm()
+    {
+        return vec3(1.0, InstanceRoughness, InstanceAlbedoMetallic.a);
+    }
+#elif defined(MATERIAL_ATLAS)
+    // see MaterialAtlas: the instance's constants and layers, -1 for channels without a map.
+    flat in int MaterialIndex;
+
+    uniform sampler2DArray albedoMap;
+    uniform sampler2DArray normalMap;
+    uniform sampler2DArray ormMap;
+    uniform samplerBuffer materialData;
+
+    vec4 materialtexel(int i)
+    {
+        return texelFetch(materialData, MaterialIndex * 2 + i);
+    }
+
+    vec4 materiallayer(sampler2DArray map, float layer)
+    {
+#ifdef SPHERE_IMPOSTOR
+        return textureGrad(map, vec3(TexCoords, layer), TexCoordsDx, TexCoordsDy);
+#else
+        return texture(map, vec3(TexCoords, layer));
+#endif
+    }
+
+    vec3 materialcolor()
+    {
+        float layer = materialtexel(1).y;
+        return layer < 0.0 ? materialtexel(0).rgb : materiallayer(albedoMap, layer).rgb;
+    }
 
+    vec3 materialorm()
+    {
+        float layer = materialtexel(1).w;
+        return layer < 0.0 ? vec3(1.0, materialtexel(1).x, materialtexel(0).a) : materiallayer(ormMap, layer).rgb;
+    }
+
+    // the unperturbed normal for materials without a map.
+    vec3 materialnormal()
+    {
+        float layer = materialtexel(1).z;
+        if (layer < 0.0)
+            return vec3(0.0, 0.0, 1.0);
+        vec2 xy = materiallayer(normalMap, layer).rg * 2.0 - 1.0;
+        return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+    }
+#else
+    // constant channels come in as uniforms so their 1x1 textures are never sampled.
+#ifdef CONSTANT_ALBEDO
+    uniform vec3 albedoConstant;
+#else
     uniform sampler2D albedoMap;
+#endif
+#ifdef NORMAL_MAP
     uniform sampler2D normalMap;
+#endif
+#ifdef PACKED_ORM
+    uniform sampler2D ormMap;
+#else
+#ifdef CONSTANT_METALLIC
+    uniform float metallicConstant;
+#else
     uniform sampler2D metallicMap;
+#endif
+#ifdef CONSTANT_ROUGHNESS
+    uniform float roughnessConstant;
+#else
     uniform sampler2D roughnessMap;
-    uniform samplerCube irradianceMap;
-    uniform samplerCube prefilterMap;
-    uniform sampler2D brdflutMap;
-
-    uniform vec3 viewPos;
+#endif
+#endif
 
     vec3 materialcolor()
     {
-        return pow(texture(albedoMap, TexCoords).rgb, vec3(2.2));
+#ifdef CONSTANT_ALBEDO
+        return albedoConstant;
+#else
+        return texture(albedoMap, TexCoords).rgb;
+#endif
+    }
+
+#ifndef PACKED_ORM
+    float materialmetallic()
+    {
+#ifdef CONSTANT_METALLIC
+        return metallicConstant;
+#else
+        return texture(metallicMap, TexCoords).r;
+#endif
     }
 
+    float materialroughness()
+    {
+#ifdef CONSTANT_ROUGHNESS
+        return roughnessConstant;
+#else
+        return texture(roughnessMap, TexCoords).r;
+#endif
+    }
+#endif
+
+    // occlusion, roughness and metallic, in the channels the packed map stores them in.
+    vec3 materialorm()
+    {
+#ifdef PACKED_ORM
+        return texture(ormMap, TexCoords).rgb;
+#else
+        return vec3(1.0, materialroughness(), materialmetallic());
+#endif
+    }
+
+#ifdef NORMAL_MAP
+    // only x and y are stored (BC5 has two channels), z is implied by unit length.
+    vec3 materialnormal()
+    {
+        vec2 xy = texture(normalMap, TexCoords).rg * 2.0 - 1.0;
+        return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+    }
+#endif
+#endif
+
     vec3 computeTBN()
     {
-        vec3 tangentNormal = texture(normalMap, TexCoords).xyz * 2.0 - 1.0;
+#if defined(NORMAL_MAP) && defined(VERTEX_TANGENTS)
+        vec3 tangentNormal = materialnormal();
+
+        vec3 N = normalize(Normal);
+        vec3 T = normalize(Tangent.xyz - N * dot(N, Tangent.xyz));
+        // negated like the derivative path below, for the maps' green channel.
+        vec3 B = -Tangent.w * cross(N, T);
+        mat3 TBN = mat3(T, B, N);
+
+        return normalize(TBN * tangentNormal);
+#elif defined(NORMAL_MAP)
+        vec3 tangentNormal = materialnormal();
 
         vec3 Q1  = dFdx(WorldPos);
         vec3 Q2  = dFdy(WorldPos);
@@ -79,10 +349,94 @@ R"( #version 330 core
         mat3 TBN = mat3(T, B, N);
 
         return normalize(TBN * tangentNormal);
+#else
+        return normalize(Normal);
+#endif
     }
+)";
+constexpr const char* clustered_lights_source =
+R"(
+    uniform samplerBuffer lightData;
+    uniform usamplerBuffer lightGrid;
+    uniform usamplerBuffer lightIndices;
+
+    uniform mat4 uView;
+    uniform vec2 clusterTileScale;
+    uniform vec2 clusterSliceParams;
+    uniform ivec3 clusterDims;
+
+    // offset into lightIndices and light count of the cluster containing P.
+    uvec2 clusterLights(vec3 P)
+    {
+        float depth = -(uView * vec4(P, 1.0)).z;
+        int slice = clamp(int(log(depth) * clusterSliceParams.x + clusterSliceParams.y), 0, clusterDims.z - 1);
+        ivec2 tile = clamp(ivec2(gl_FragCoord.xy * clusterTileScale), ivec2(0), clusterDims.xy - 1);
+        int cluster = (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x;
+        return texelFetch(lightGrid, cluster).rg;
+    }
+)";
+constexpr const char* pbr_lighting_source =
+R"(
+    // 0 = low, 1 = medium, 2 = high (the reference). see Shaders::Quality.
+#ifndef QUALITY
+#define QUALITY 2
+#endif
+
+#if QUALITY == 0
+    const uint MAX_LIGHTS = 8u;
+#elif QUALITY == 1
+    const uint MAX_LIGHTS = 32u;
+#else
+    const uint MAX_LIGHTS = 0xFFFFFFFFu;
+#endif
+
+    uniform samplerCube irradianceMap;
+    uniform samplerCube prefilterMap;
+#if QUALITY > 0
+    uniform sampler2D brdflutMap;
+#endif
 
     const float PI = 3.14159265359;
 
+    // everything about the shaded point that does not depend on the light.
+    struct Surface
+    {
+        vec3 N;
+        vec3 V;
+        float dotNV;
+        vec3 albedo;
+        vec3 F0;
+        vec3 F;
+        float metallic;
+        float roughness;
+        float occlusion;
+    };
+
+    vec3 F_Schlick(float cosTheta, vec3 F0)
+    {
+        return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+    }
+
+    vec3 F_SchlickRoughness(float cosTheta, vec3 F0, float roughness)
+    {
+        return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+    }
+
+    Surface makeSurface(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness, float occlusion)
+    {
+        Surface s;
+        s.N = N;
+        s.V = V;
+        s.dotNV = clamp(dot(N, V), 0.0, 1.0);
+        s.albedo = albedo;
+        s.F0 = mix(vec3(0.04), albedo, metallic);
+        s.F = F_Schlick(s.dotNV, s.F0);
+        s.metallic = metallic;
+        s.roughness = roughness;
+        s.occlusion = occlusion;
+        return s;
+    }
+
     float D_GGX(float dotNH, float roughness)
     {
         float alpha = roughness * roughness;
@@ -100,87 +454,221 @@ R"( #version 330 core
         return GL * GV;
     }
 
-    vec3 F_Schlick(float cosTheta, float metallic)
+    vec3 BRDF(vec3 L, Surface s)
     {
-        vec3 F0 = mix(vec3(0.04), materialcolor(), metallic);
-        return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-    }
-
-    vec3 F_SchlickRoughness(float cosTheta, float metallic, float roughness)
-    {
-        vec3 F0 = mix(vec3(0.04), materialcolor(), metallic);
-        return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-    }
-
-    vec3 BRDF(vec3 L, vec3 V, vec3 N, float metallic, float roughness)
-    {
-        vec3 H = normalize (V + L);
-        float dotNV = clamp(dot(N, V), 0.0, 1.0);
-        float dotNL = clamp(dot(N, L), 0.0, 1.0);
-        float dotLH = clamp(dot(L, H), 0.0, 1.0);
-        float dotNH = clamp(dot(N, H), 0.0, 1.0);
-
-        vec3 lightColor = vec3(1.0);
+        vec3 H = normalize (s.V + L);
+        float dotNL = clamp(dot(s.N, L), 0.0, 1.0);
+        float dotNH = clamp(dot(s.N, H), 0.0, 1.0);
 
         vec3 color = vec3(0);
 
         if (dotNL > 0.0)
         {
-            float R = max(0.05, roughness);
+            float R = max(0.05, s.roughness);
             float D = D_GGX(dotNH, R);
-            float G = G_SchlicksmithGGX(dotNL, dotNV, R);
-            vec3 F = F_Schlick(dotNV, metallic);
+            float G = G_SchlicksmithGGX(dotNL, s.dotNV, R);
 
-            vec3 spec = D * F * G / (4.0 * dotNL * dotNV);
+            vec3 spec = D * s.F * G / (4.0 * dotNL * s.dotNV);
 
-            color += spec * dotNL * lightColor;
+            color += spec * dotNL;
         }
 
         return color;
     }
 
-    void main()
+    // scale and bias applied to F0 by the split-sum environment BRDF.
+    vec2 envBRDF(float dotNV, float roughness)
     {
-        vec3 N = computeTBN();
-        vec3 V = normalize(viewPos - WorldPos);
-        float metallic = texture(metallicMap, TexCoords).r;
-        float roughness = texture(roughnessMap, TexCoords).r;
-
-        #define NUM_LIGHTS 4
-        vec3 lightPos[] = vec3[](
-            vec3(1.0f, 0.0f, 0.0f),
-            vec3(-1.0f, 0.0f, 0.0f),
-            vec3(0.0f, 0.0f, 1.0f),
-            vec3(0.0f, 0.0f, -1.0f)
-        );
+#if QUALITY == 0
+        // analytic fit of the LUT (Karis, "Physically Based Shading on Mobile").
+        const vec4 c0 = vec4(-1.0, -0.0275, -0.572, 0.022);
+        const vec4 c1 = vec4(1.0, 0.0425, 1.04, -0.04);
+        vec4 r = roughness * c0 + c1;
+        float a004 = min(r.x * r.x, exp2(-9.28 * dotNV)) * r.x + r.y;
+        return vec2(-1.04, 1.04) * a004 + r.zw;
+#else
+        return texture(brdflutMap, vec2(dotNV, roughness)).rg;
+#endif
+    }
 
+    vec3 shade(vec3 P, Surface s)
+    {
         vec3 Lo = vec3(0.0);
-        for (int i = 0; i < NUM_LIGHTS; i++) {
-          vec3 L = normalize(lightPos[i] - WorldPos);
-          Lo += BRDF(L, V, N, metallic, roughness);
+        uvec2 cluster = clusterLights(P);
+        uint count = min(cluster.y, MAX_LIGHTS);
+        for (uint i = 0u; i < count; i++) {
+            int light = int(texelFetch(lightIndices, int(cluster.x + i)).r);
+            vec4 positionRadius = texelFetch(lightData, light*3 + 0);
+            vec4 colorOuter     = texelFetch(lightData, light*3 + 1);
+            vec4 directionInner = texelFetch(lightData, light*3 + 2);
+
+            vec3 toLight = positionRadius.xyz - P;
+            float distance = length(toLight);
+            vec3 L = toLight / distance;
+
+            // windowed falloff reaching zero at the light radius, and the spot cone;
+            // point lights (outer cosine -1) skip the cone, smoothstep needs ordered edges.
+            float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+            float cone = 1.0;
+            if (colorOuter.w > -1.0) {
+                cone = smoothstep(colorOuter.w, directionInner.w, dot(-L, directionInner.xyz));
+            }
+
+            Lo += BRDF(L, s) * colorOuter.rgb * (window * window * cone);
         }
 
-        vec3 kS = F_SchlickRoughness(max(dot(N, V), 0.0), metallic, roughness);
-        vec3 kD = (1.0 - kS) * (1.0 - metallic);
+        vec3 kS = F_SchlickRoughness(s.dotNV, s.F0, s.roughness);
+        vec3 kD = (1.0 - kS) * (1.0 - s.metallic);
 
-        vec3 irradiance = texture(irradianceMap, N).rgb;
-        vec3 diffuse    = irradiance * materialcolor();
+        vec3 irradiance = texture(irradianceMap, s.N).rgb;
+        vec3 diffuse    = irradiance * s.albedo;
 
         const float MAX_REFLECTION_LOD = 4.0;
-        vec3 prefilter = textureLod(prefilterMap, reflect(-V, N), roughness * MAX_REFLECTION_LOD).rgb;
-        vec2 brdf      = texture(brdflutMap, vec2(max(dot(N, V), 0.0), roughness)).rg;
+        vec3 prefilter = textureLod(prefilterMap, reflect(-s.V, s.N), s.roughness * MAX_REFLECTION_LOD).rgb;
+        vec2 brdf      = envBRDF(s.dotNV, s.roughness);
         vec3 specular  = prefilter * (kS * brdf.x + brdf.y);
 
-        vec3 ambient = (kD * diffuse + specular); // * ao
-        vec3 color = Lo + ambient;
+        vec3 ambient = (kD * diffuse + specular) * s.occlusion;
+        return Lo + ambient;
+    }
+)";
+constexpr const char* pbr_frag_source =
+R"(
+    out vec4 FragColor;
+
+    uniform vec3 viewPos;
 
-        color = color / (color + vec3(1.0));
-        color = pow(color, vec3(1.0/2.2));
+    void main()
+    {
+#ifdef SPHERE_IMPOSTOR
+        traceImpostor();
+#endif
+        vec3 N = computeTBN();
+        vec3 V = normalize(viewPos - WorldPos);
+        vec3 orm = materialorm();
+        vec3 color = shade(WorldPos, makeSurface(N, V, materialcolor(), orm.b, orm.g, orm.r));
         FragColor = vec4(color, 1.0);
     }
 )";
+constexpr const char* gbuffer_source =
+R"(
+    vec2 octWrap(vec2 v)
+    {
+        return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    // octahedral mapping of a unit vector to [0, 1]^2
+    vec2 encodeNormal(vec3 n)
+    {
+        n /= abs(n.x) + abs(n.y) + abs(n.z);
+        n.xy = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+        return n.xy * 0.5 + 0.5;
+    }
+
+    vec3 decodeNormal(vec2 f)
+    {
+        f = f * 2.0 - 1.0;
+        vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+        float t = clamp(-n.z, 0.0, 1.0);
+        n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+        return normalize(n);
+    }
+)";
+constexpr const char* gbuffer_frag_source =
+R"(
+    layout(location = 0) out vec4 gAlbedo;
+    layout(location = 1) out vec2 gNormal;
+    layout(location = 2) out vec2 gMaterial;
+
+    void main()
+    {
+#ifdef SPHERE_IMPOSTOR
+        traceImpostor();
+#endif
+        vec3 orm = materialorm();
+        gAlbedo = vec4(materialcolor(), orm.r);
+        gNormal = encodeNormal(computeTBN());
+        gMaterial = orm.bg;
+    }
+)";
+constexpr const char* deferred_frag_source =
+R"(
+    in vec2 TexCoords;
+    out vec4 FragColor;
+
+    uniform sampler2D gAlbedo;
+    uniform sampler2D gNormal;
+    uniform sampler2D gMaterial;
+    uniform sampler2D gDepth;
+
+    uniform mat4 invViewProj;
+    uniform vec3 viewPos;
+
+    void main()
+    {
+        float depth = texture(gDepth, TexCoords).r;
+        if (depth == 1.0)
+            discard; // left for the sky
+
+        vec4 clip = invViewProj * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+        vec3 P = clip.xyz / clip.w;
+        vec3 N = decodeNormal(texture(gNormal, TexCoords).rg);
+        vec3 V = normalize(viewPos - P);
+        vec2 material = texture(gMaterial, TexCoords).rg;
+        vec4 albedo = texture(gAlbedo, TexCoords);
+
+        vec3 color = shade(P, makeSurface(N, V, albedo.rgb, material.r, material.g, albedo.a));
+        FragColor = vec4(color, 1.0);
+        gl_FragDepth = depth;
+    }
+)";
+constexpr const char* depth_vert_source =
+R"(
+
+    layout(location = 0) in vec3 aPosition;
+
+#ifdef INSTANCED
+    layout(location = 4) in mat4 aModel;
+
+    uniform mat4 uViewProj;
+#else
+    uniform mat4 MVP;
+#endif
+
+    // must match pbr_vert_source bit for bit so the shading pass can test with GL_LEQUAL.
+    invariant gl_Position;
+
+    void main() {
+#ifdef INSTANCED
+        gl_Position = uViewProj * (aModel * vec4(aPosition, 1.0));
+#else
+        gl_Position = MVP * vec4(aPosition, 1.0);
+#endif
+    }
+)";
+constexpr const char* depth_frag_source =
+R"(
+
+    void main() {
+#ifdef SPHERE_IMPOSTOR
+        traceImpostor();
+#endif
+    }
+)";
+constexpr const char* fullscreen_vert_source =
+R"(
+    out vec2 TexCoords;
+
+    void main()
+    {
+        float x = float((gl_VertexID & 1) << 2);
+        float y = float((gl_VertexID & 2) << 1);
+        gl_Position = vec4(x - 1.0, y - 1.0, 0, 1);
+        TexCoords = vec2(x, y) * 0.5;
+    }
+)";
 constexpr const char* bakehdr_vert_source =
-R"( #version 330 core
+R"(
 
     out vec2 TexCoords;
 
@@ -193,7 +681,7 @@ R"( #version 330 core
     }
 )";
 constexpr const char* bakehdr_frag_source =
-R"( #version 330 core
+R"(
     #define MATH_PI 3.1415926535897932384626433832795
 
     in vec2 TexCoords;
@@ -237,7 +725,7 @@ R"( #version 330 core
     }
 )";
 constexpr const char* bakehdr_irradiance_convolution_frag_source =
-R"( #version 330 core
+R"(
 
     in vec2 TexCoords;
     out vec4 FragColor;
@@ -289,7 +777,7 @@ R"( #version 330 core
     }
 )";
 constexpr const char* bakehdr_prefilter_frag_source =
-R"( #version 330 core
+R"(
 
     in vec2 TexCoords;
     out vec4 FragColor;
@@ -407,7 +895,7 @@ R"( #version 330 core
     }
 )";
 constexpr const char* skybox_vert_source =
-R"( #version 330 core
+R"(
 
     out vec3 TexCoords;
     uniform mat4 uProj;
@@ -436,11 +924,12 @@ R"( #version 330 core
     void main()
     {
         TexCoords = (vertices[faces[gl_VertexID]] - 0.5)*2;
-        gl_Position = uProj * mat4(mat3(uView)) * vec4(TexCoords, 1.0);
+        // z = w puts the cube on the far plane, so it only passes where nothing was drawn.
+        gl_Position = (uProj * mat4(mat3(uView)) * vec4(TexCoords, 1.0)).xyww;
     }
 )";
 constexpr const char* skybox_frag_source =
-R"( #version 330 core
+R"(
 
     in vec3 TexCoords;
     out vec4 FragColor;
@@ -449,43 +938,358 @@ R"( #version 330 core
 
     void main()
     {
-        vec3 color = texture(skybox, TexCoords).rgb;
-        color = color / (color + vec3(1.0));
-        color = pow(color, vec3(1.0/2.2));
+        FragColor = vec4(texture(skybox, TexCoords).rgb, 1);
+    }
+)";
+constexpr const char* tonemap_frag_source =
+R"(
+
+    in vec2 TexCoords;
+    out vec4 FragColor;
+
+#if SAMPLES > 1
+    uniform sampler2DMS hdr;
+#else
+    uniform sampler2D hdr;
+#endif
+    uniform float exposure;
+
+    vec3 tonemap(vec3 color)
+    {
+        color *= exposure;
+        return color / (color + vec3(1.0));
+    }
+
+    // the sRGB encode is done by GL_FRAMEBUFFER_SRGB on write.
+    void main()
+    {
+#if SAMPLES > 1
+        // resolving after the tonemap keeps bright samples from dominating edges.
+        ivec2 pixel = ivec2(gl_FragCoord.xy);
+        vec3 color = vec3(0.0);
+        for (int i = 0; i < SAMPLES; i++)
+            color += tonemap(texelFetch(hdr, pixel, i).rgb);
+        color /= float(SAMPLES);
+#else
+        vec3 color = tonemap(texture(hdr, TexCoords).rgb);
+#endif
         FragColor = vec4(color, 1);
     }
 )";
+constexpr const char* fxaa_frag_source =
+R"(
+
+    in vec2 TexCoords;
+    out vec4 FragColor;
+
+    uniform sampler2D ldr;
+
+    const float edgeThresholdMin = 0.0312;
+    const float edgeThresholdMax = 0.125;
+    const float subpixelQuality = 0.75;
+    const int iterations = 12;
+    const float stepScale[12] = float[12](1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0);
+
+    // perceptual luma of the linear color.
+    float luma(vec3 color)
+    {
+        return sqrt(dot(color, vec3(0.299, 0.587, 0.114)));
+    }
+
+    float lumaAt(vec2 uv)
+    {
+        return luma(textureLod(ldr, uv, 0.0).rgb);
+    }
+
+    // FXAA 3.11 quality preset: find the edge direction, walk along it to
+    // both ends and blend across it by the distance to the nearer end.
+    void main()
+    {
+        vec2 texel = 1.0 / vec2(textureSize(ldr, 0));
+        vec3 colorCenter = textureLod(ldr, TexCoords, 0.0).rgb;
+
+        float lumaCenter = luma(colorCenter);
+        float lumaDown  = luma(textureLodOffset(ldr, TexCoords, 0.0, ivec2( 0, -1)).rgb);
+        float lumaUp    = luma(textureLodOffset(ldr, TexCoords, 0.0, ivec2( 0,  1)).rgb);
+        float lumaLeft  = luma(textureLodOffset(ldr, TexCoords, 0.0, ivec2(-1,  0)).rgb);
+        float lumaRight = luma(textureLodOffset(ldr, TexCoords, 0.0, ivec2( 1,  0)).rgb);
+
+        float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+        float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+        float lumaRange = lumaMax - lumaMin;
+        if (lumaRange < max(edgeThresholdMin, lumaMax * edgeThresholdMax)) {
+            FragColor = vec4(colorCenter, 1.0);
+            return;
+        }
+
+        float lumaDownLeft  = luma(textureLodOffset(ldr, TexCoords, 0.0, ivec2(-1, -1)).rgb);
+        float lumaUpRight   = luma(textureLodOffset(ldr, TexCoords, 0.0, ivec2( 1,  1)).rgb);
+        float lumaUpLeft    = luma(textureLodOffset(ldr, TexCoords, 0.0, ivec2(-1,  1)).rgb);
+        float lumaDownRight = luma(textureLodOffset(ldr, TexCoords, 0.0, ivec2( 1, -1)).rgb);
+
+        float lumaDownUp = lumaDown + lumaUp;
+        float lumaLeftRight = lumaLeft + lumaRight;
+        float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+        float lumaDownCorners = lumaDownLeft + lumaDownRight;
+        float lumaRightCorners = lumaDownRight + lumaUpRight;
+        float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+        float edgeHorizontal = abs(-2.0 * lumaLeft + lumaLeftCorners) + abs(-2.0 * lumaCenter + lumaDownUp) * 2.0 + abs(-2.0 * lumaRight + lumaRightCorners);
+        float edgeVertical = abs(-2.0 * lumaUp + lumaUpCorners) + abs(-2.0 * lumaCenter + lumaLeftRight) * 2.0 + abs(-2.0 * lumaDown + lumaDownCorners);
+        bool horizontal = edgeHorizontal >= edgeVertical;
+
+        float luma1 = horizontal ? lumaDown : lumaLeft;
+        float luma2 = horizontal ? lumaUp : lumaRight;
+        float gradient1 = luma1 - lumaCenter;
+        float gradient2 = luma2 - lumaCenter;
+        bool steepest1 = abs(gradient1) >= abs(gradient2);
+        float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+        float stepLength = horizontal ? texel.y : texel.x;
+        float lumaLocalAverage;
+        if (steepest1) {
+            stepLength = -stepLength;
+            lumaLocalAverage = 0.5 * (luma1 + lumaCenter);
+        } else {
+            lumaLocalAverage = 0.5 * (luma2 + lumaCenter);
+        }
+
+        vec2 uv = TexCoords;
+        if (horizontal) {
+            uv.y += stepLength * 0.5;
+        } else {
+            uv.x += stepLength * 0.5;
+        }
+
+        vec2 offset = horizontal ? vec2(texel.x, 0.0) : vec2(0.0, texel.y);
+        vec2 uv1 = uv - offset;
+        vec2 uv2 = uv + offset;
+        float lumaEnd1 = 0.0, lumaEnd2 = 0.0;
+        bool reached1 = false, reached2 = false;
+        for (int i = 0; i < iterations; i++) {
+            if (!reached1)
+                lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+            if (!reached2)
+                lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+            if (reached1 && reached2)
+                break;
+            if (!reached1)
+                uv1 -= offset * stepScale[i];
+            if (!reached2)
+                uv2 += offset * stepScale[i];
+        }
+
+        float distance1 = horizontal ? (TexCoords.x - uv1.x) : (TexCoords.y - uv1.y);
+        float distance2 = horizontal ? (uv2.x - TexCoords.x) : (uv2.y - TexCoords.y);
+        bool direction1 = distance1 < distance2;
+        float distanceFinal = min(distance1, distance2);
+        float pixelOffset = 0.5 - distanceFinal / (distance1 + distance2);
+
+        // only blend when the nearer end moves away from the center's side of the edge.
+        bool centerSmaller = lumaCenter < lumaLocalAverage;
+        bool correctVariation = ((direction1 ? lumaEnd1 : lumaEnd2) < 0.0) != centerSmaller;
+        float finalOffset = correctVariation ? pixelOffset : 0.0;
+
+        // sub-pixel aliasing, from the 3x3 average against the center.
+        float lumaAverage = (1.0/12.0) * (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+        float subpixel = clamp(abs(lumaAverage - lumaCenter) / lumaRange, 0.0, 1.0);
+        subpixel = (-2.0 * subpixel + 3.0) * subpixel * subpixel;
+        finalOffset = max(finalOffset, subpixel * subpixel * subpixelQuality);
+
+        vec2 finalUv = TexCoords;
+        if (horizontal) {
+            finalUv.y += finalOffset * stepLength;
+        } else {
+            finalUv.x += finalOffset * stepLength;
+        }
+        FragColor = vec4(textureLod(ldr, finalUv, 0.0).rgb, 1.0);
+    }
+)";
+constexpr const char* taa_frag_source =
+R"(
+
+    in vec2 TexCoords;
+    out vec4 FragColor;
+
+    uniform sampler2D current;
+    uniform sampler2D currentDepth;
+    uniform sampler2D history;
+
+    uniform mat4 reprojection;  // output NDC to the previous frame's clip space
+    uniform vec2 jitter;        // of the current frame, in uv
+    uniform float historyWeight;
+
+    // weighting by 1/(1+luma) keeps lone bright samples from flickering.
+    float weight(vec3 color)
+    {
+        return 1.0 / (1.0 + dot(color, vec3(0.299, 0.587, 0.114)));
+    }
+
+    void main()
+    {
+        // the current frame is smaller and jittered: undo the jitter, upscale bilinearly.
+        vec2 uv = TexCoords + jitter;
+        vec2 texel = 1.0 / vec2(textureSize(current, 0));
+        vec3 color = texture(current, uv).rgb;
+
+        float depth = texture(currentDepth, uv).r;
+        vec4 previous = reprojection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+        vec2 previousUv = previous.xy / previous.w * 0.5 + 0.5;
+        if (historyWeight == 0.0 || any(lessThan(previousUv, vec2(0.0))) || any(greaterThan(previousUv, vec2(1.0)))) {
+            FragColor = vec4(color, 1.0);
+            return;
+        }
+
+        // history outside the current neighbourhood is stale and gets clamped.
+        vec3 lo = color, hi = color;
+        for (int y = -1; y <= 1; y++) {
+            for (int x = -1; x <= 1; x++) {
+                vec3 c = texture(current, uv + vec2(x, y) * texel).rgb;
+                lo = min(lo, c);
+                hi = max(hi, c);
+            }
+        }
+        vec3 past = clamp(texture(history, previousUv).rgb, lo, hi);
+
+        float a = (1.0 - historyWeight) * weight(color);
+        float b = historyWeight * weight(past);
+        FragColor = vec4((color * a + past * b) / (a + b), 1.0);
+    }
+)";
+
+/* the #defines selecting a material variant, placed right after #version. */
+std::string variantDefines(unsigned variant) {
+    std::string defines;
+    if (variant & Shaders::NormalMap)         defines += "#define NORMAL_MAP\n";
+    if (variant & Shaders::ConstantAlbedo)    defines += "#define CONSTANT_ALBEDO\n";
+    if (variant & Shaders::ConstantMetallic)  defines += "#define CONSTANT_METALLIC\n";
+    if (variant & Shaders::ConstantRoughness) defines += "#define CONSTANT_ROUGHNESS\n";
+    if (variant & Shaders::VertexTangents)    defines += "#define VERTEX_TANGENTS\n";
+    if (variant & Shaders::PackedORM)         defines += "#define PACKED_ORM\n";
+    if (variant & Shaders::MaterialAtlas)     defines += "#define MATERIAL_ATLAS\n";
+    if (variant & Shaders::ParametricMaterial) defines += "#define PARAMETRIC_MATERIAL\n";
+    if (variant & Shaders::SphereImpostor)    defines += "#define SPHERE_IMPOSTOR\n";
+    return defines;
+}
 
 namespace Shaders {
     GLuint pbr_vert;
+    GLuint pbr_instanced_vert;
+    GLuint depth_vert;
+    GLuint depth_instanced_vert;
+    GLuint sphere_impostor_vert;
+    GLuint fullscreen_vert;
     GLuint bakehdr_vert;
     GLuint skybox_vert;
 
-    GLuint pbr_frag;
+    GLuint pbr_frag[QualityCount][MaterialVariantCount];
+    GLuint depth_frag;
+    GLuint depth_impostor_frag;
+    GLuint gbuffer_frag[MaterialVariantCount];
+    GLuint deferred_frag;
     GLuint bakehdr_frag;
     GLuint bakehdr_irradiance_convolution_frag;
     GLuint bakehdr_prefilter_frag;
     GLuint skybox_frag;
+    GLuint tonemap_frag[SampleCountCount];
+    GLuint fxaa_frag;
+    GLuint taa_frag;
 
     GLuint pbrVertexShader()                             { return pbr_vert; }
+    GLuint pbrInstancedVertexShader()                    { return pbr_instanced_vert; }
+    GLuint depthVertexShader()                           { return depth_vert; }
+    GLuint depthInstancedVertexShader()                  { return depth_instanced_vert; }
+    GLuint sphereImpostorVertexShader()                  { return sphere_impostor_vert; }
+    GLuint fullscreenVertexShader()                      { return fullscreen_vert; }
     GLuint bakehdrVertexShader()                         { return bakehdr_vert; }
     GLuint skyboxVertexShader()                          { return skybox_vert; }
 
-    GLuint pbrFragmentShader()                           { return pbr_frag; }
+    GLuint depthFragmentShader()                         { return depth_frag; }
+    GLuint depthImpostorFragmentShader()                 { return depth_impostor_frag; }
+    GLuint deferredFragmentShader()                      { return deferred_frag; }
     GLuint bakehdrFragmentShader()                       { return bakehdr_frag; }
     GLuint bakehdrIrradianceConvolutionFragmentShader()  { return bakehdr_irradiance_convolution_frag; }
     GLuint bakehdrPrefilterFragmentShader()              { return bakehdr_prefilter_frag; }
     GLuint skyboxFragmentShader()                        { return skybox_frag; }
+    GLuint fxaaFragmentShader()                          { return fxaa_frag; }
+    GLuint taaFragmentShader()                           { return taa_frag; }
+
+    uint64_t getSourceHash(GLuint shader) {
+        return shaderStates.at(shader).hash;
+    }
+
+    void submitCompile(GLuint shader) {
+        ShaderState& state = shaderStates.at(shader);
+        if (!state.submitted) {
+            glCompileShader(shader);
+            state.submitted = true;
+        }
+    }
+
+    void checkCompile(GLuint shader) {
+        ShaderState& state = shaderStates.at(shader);
+        if (state.checked)
+            return;
+        state.checked = true;
+
+        int length;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        if (length > 0) {
+            std::vector<char> message(length+1);
+            glGetShaderInfoLog(shader, length, NULL, message.data());
+            throw std::runtime_error(std::string(message.data()));
+        }
+    }
+
+    /* variants are created the first time a material needs them. */
+    GLuint pbrFragmentShader(unsigned variant, Quality quality) {
+        if (pbr_frag[quality][variant] == 0) {
+            std::string defines = variantDefines(variant) + "#define QUALITY " + std::to_string(quality) + "\n";
+            pbr_frag[quality][variant] = createShader(GL_FRAGMENT_SHADER, { defines.c_str(), sphere_impostor_source, pbr_material_source, clustered_lights_source, pbr_lighting_source, pbr_frag_source });
+        }
+        return pbr_frag[quality][variant];
+    }
+
+    GLuint gbufferFragmentShader(unsigned variant) {
+        if (gbuffer_frag[variant] == 0) {
+            std::string defines = variantDefines(variant);
+            gbuffer_frag[variant] = createShader(GL_FRAGMENT_SHADER, { defines.c_str(), sphere_impostor_source, pbr_material_source, gbuffer_source, gbuffer_frag_source });
+        }
+        return gbuffer_frag[variant];
+    }
+
+    GLuint tonemapFragmentShader(SampleCount samples) {
+        if (tonemap_frag[samples] == 0) {
+            std::string defines = "#define SAMPLES " + std::to_string(1 << samples) + "\n";
+            tonemap_frag[samples] = createShader(GL_FRAGMENT_SHADER, { defines.c_str(), tonemap_frag_source });
+        }
+        return tonemap_frag[samples];
+    }
 
     void compile() {
-        pbr_vert                            = compileShader(GL_VERTEX_SHADER, pbr_vert_source);
-        bakehdr_vert                        = compileShader(GL_VERTEX_SHADER, bakehdr_vert_source);
-        skybox_vert                         = compileShader(GL_VERTEX_SHADER, skybox_vert_source);
-
-        pbr_frag                            = compileShader(GL_FRAGMENT_SHADER, pbr_frag_source);
-        bakehdr_frag                        = compileShader(GL_FRAGMENT_SHADER, bakehdr_frag_source);
-        bakehdr_irradiance_convolution_frag = compileShader(GL_FRAGMENT_SHADER, bakehdr_irradiance_convolution_frag_source);
-        bakehdr_prefilter_frag              = compileShader(GL_FRAGMENT_SHADER, bakehdr_prefilter_frag_source);
-        skybox_frag                         = compileShader(GL_FRAGMENT_SHADER, skybox_frag_source);
+        if (GLAD_GL_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // let the driver pick
+        }
+
+        pbr_vert                            = createShader(GL_VERTEX_SHADER, { pbr_vert_source });
+        pbr_instanced_vert                  = createShader(GL_VERTEX_SHADER, { "#define INSTANCED\n", pbr_vert_source });
+        depth_vert                          = createShader(GL_VERTEX_SHADER, { depth_vert_source });
+        depth_instanced_vert                = createShader(GL_VERTEX_SHADER, { "#define INSTANCED\n", depth_vert_source });
+        sphere_impostor_vert                = createShader(GL_VERTEX_SHADER, { sphere_impostor_vert_source });
+        fullscreen_vert                     = createShader(GL_VERTEX_SHADER, { fullscreen_vert_source });
+        bakehdr_vert                        = createShader(GL_VERTEX_SHADER, { bakehdr_vert_source });
+        skybox_vert                         = createShader(GL_VERTEX_SHADER, { skybox_vert_source });
+
+        depth_frag                          = createShader(GL_FRAGMENT_SHADER, { depth_frag_source });
+        depth_impostor_frag                 = createShader(GL_FRAGMENT_SHADER, { "#define SPHERE_IMPOSTOR\n", sphere_impostor_source, depth_frag_source });
+        deferred_frag                       = createShader(GL_FRAGMENT_SHADER, { clustered_lights_source, pbr_lighting_source, gbuffer_source, deferred_frag_source });
+        bakehdr_frag                        = createShader(GL_FRAGMENT_SHADER, { bakehdr_frag_source });
+        bakehdr_irradiance_convolution_frag = createShader(GL_FRAGMENT_SHADER, { bakehdr_irradiance_convolution_frag_source });
+        bakehdr_prefilter_frag              = createShader(GL_FRAGMENT_SHADER, { bakehdr_prefilter_frag_source });
+        skybox_frag                         = createShader(GL_FRAGMENT_SHADER, { skybox_frag_source });
+        fxaa_frag                           = createShader(GL_FRAGMENT_SHADER, { fxaa_frag_source });
+        taa_frag                            = createShader(GL_FRAGMENT_SHADER, { taa_frag_source });
     }
 }
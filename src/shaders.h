@@ -1,14 +1,71 @@
 #pragma once
 #include <glad.h>
+#include <cstdint>
 
 namespace Shaders {
+    /* feature bits of a PBR material, each one a #define in the variant. */
+    enum MaterialVariant : unsigned {
+        NormalMap         = 1 << 0,
+        ConstantAlbedo    = 1 << 1,
+        ConstantMetallic  = 1 << 2,
+        ConstantRoughness = 1 << 3,
+        VertexTangents    = 1 << 4, // geometry property, only used with NormalMap
+        PackedORM         = 1 << 5, // occlusion/roughness/metallic in one map, instead of ConstantMetallic/Roughness
+        MaterialAtlas     = 1 << 6, // instanced, per-instance material from a MaterialAtlas; only with NormalMap
+        ParametricMaterial = 1 << 7, // instanced, albedo/metallic/roughness per instance and no maps; alone
+        SphereImpostor    = 1 << 8, // with an instanced variant: ray-traced spheres on quads
+        MaterialVariantCount = 1 << 9,
+    };
+
+    /* the variants drawn with pbrInstancedVertexShader, or sphereImpostorVertexShader. */
+    constexpr unsigned InstancedVariants = MaterialAtlas | ParametricMaterial;
+
+    /* forward shading tiers. Low uses an analytic environment BRDF and at
+     * most 8 lights per cluster, Medium the LUT and 32, High everything. */
+    enum Quality : unsigned {
+        Low,
+        Medium,
+        High,
+        QualityCount,
+    };
+
+    /* log2 of the sample count of a multisampled target. */
+    enum SampleCount : unsigned {
+        Samples1,
+        Samples2,
+        Samples4,
+        Samples8,
+        SampleCountCount,
+    };
+
+    /* creates the shader objects. they are only compiled when a link misses
+     * the program cache; submitCompile returns without waiting for the
+     * driver and checkCompile is the first call that does. */
     void compile();
+    uint64_t getSourceHash(GLuint shader);
+    void submitCompile(GLuint shader);
+    void checkCompile(GLuint shader);
     GLuint pbrVertexShader();
+    /* the model matrix and material index come from RenderPass::Instance. */
+    GLuint pbrInstancedVertexShader();
+    GLuint depthVertexShader();
+    GLuint depthInstancedVertexShader();
+    /* a quad per RenderPass::Instance covering the sphere of its model matrix
+     * (unit sphere, uniform scale), drawn as a 4-vertex strip without attributes. */
+    GLuint sphereImpostorVertexShader();
+    GLuint fullscreenVertexShader();
     GLuint bakehdrVertexShader();
     GLuint skyboxVertexShader();
-    GLuint pbrFragmentShader();
+    GLuint pbrFragmentShader(unsigned variant, Quality quality);
+    GLuint depthFragmentShader();
+    GLuint depthImpostorFragmentShader();
+    GLuint gbufferFragmentShader(unsigned variant);
+    GLuint deferredFragmentShader();
     GLuint bakehdrFragmentShader();
     GLuint bakehdrIrradianceConvolutionFragmentShader();
     GLuint bakehdrPrefilterFragmentShader();
     GLuint skyboxFragmentShader();
+    GLuint tonemapFragmentShader(SampleCount samples);
+    GLuint fxaaFragmentShader();
+    GLuint taaFragmentShader();
 }
@@ -0,0 +1,197 @@
+#include "simplify.h"
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <glm/gtx/hash.hpp>
+
+namespace Simplify {
+    /* the symmetric 4x4 sum of plane equations, weighted by triangle area. */
+    struct Quadric {
+        double a2 = 0, ab = 0, ac = 0, ad = 0;
+        double b2 = 0, bc = 0, bd = 0;
+        double c2 = 0, cd = 0;
+        double d2 = 0;
+        double weight = 0;
+    };
+
+    static void addPlane(Quadric& q, const glm::dvec3& n, double d, double weight) {
+        q.a2 += n.x * n.x * weight; q.ab += n.x * n.y * weight; q.ac += n.x * n.z * weight; q.ad += n.x * d * weight;
+        q.b2 += n.y * n.y * weight; q.bc += n.y * n.z * weight; q.bd += n.y * d * weight;
+        q.c2 += n.z * n.z * weight; q.cd += n.z * d * weight;
+        q.d2 += d * d * weight;
+        q.weight += weight;
+    }
+
+    static Quadric sum(const Quadric& a, const Quadric& b) {
+        Quadric q;
+        q.a2 = a.a2 + b.a2; q.ab = a.ab + b.ab; q.ac = a.ac + b.ac; q.ad = a.ad + b.ad;
+        q.b2 = a.b2 + b.b2; q.bc = a.bc + b.bc; q.bd = a.bd + b.bd;
+        q.c2 = a.c2 + b.c2; q.cd = a.cd + b.cd;
+        q.d2 = a.d2 + b.d2;
+        q.weight = a.weight + b.weight;
+        return q;
+    }
+
+    /* mean squared distance of p to the planes. */
+    static double evaluate(const Quadric& q, const glm::dvec3& p) {
+        double e = q.a2 * p.x * p.x + 2 * q.ab * p.x * p.y + 2 * q.ac * p.x * p.z + 2 * q.ad * p.x
+                 + q.b2 * p.y * p.y + 2 * q.bc * p.y * p.z + 2 * q.bd * p.y
+                 + q.c2 * p.z * p.z + 2 * q.cd * p.z
+                 + q.d2;
+        return q.weight > 0 ? std::max(e, 0.0) / q.weight : 0.0;
+    }
+
+    struct Collapse {
+        uint32_t from; // vertices, not positions
+        uint32_t to;
+        double cost;
+    };
+
+    std::vector<uint32_t> simplify(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+        size_t targetIndexCount, float* error)
+    {
+        size_t vertexCount = positions.size();
+
+        // vertices are merged by position for topology; wedges counts the vertices at each.
+        std::vector<uint32_t> position(vertexCount);
+        std::vector<uint32_t> wedges(vertexCount, 0);
+        std::unordered_map<glm::vec3, uint32_t> first;
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            position[v] = first.emplace(positions[v], v).first->second;
+            wedges[position[v]]++;
+        }
+
+        std::vector<bool> locked(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            locked[v] = wedges[v] > 1;
+        }
+        std::unordered_map<uint64_t, int> edges;
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (int e = 0; e < 3; e++) {
+                uint32_t a = position[indices[i + e]], b = position[indices[i + (e + 1) % 3]];
+                edges[uint64_t(std::min(a, b)) << 32 | std::max(a, b)]++;
+            }
+        }
+        for (const auto& edge : edges) {
+            if (edge.second == 1) {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xFFFFFFFF] = true;
+            }
+        }
+
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            glm::dvec3 p0(positions[indices[i + 0]]), p1(positions[indices[i + 1]]), p2(positions[indices[i + 2]]);
+            glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+            double area = glm::length(n);
+            if (area == 0)
+                continue;
+            n /= area;
+            for (int k = 0; k < 3; k++) {
+                addPlane(quadrics[position[indices[i + k]]], n, -glm::dot(n, p0), area * 0.5);
+            }
+        }
+
+        std::vector<uint32_t> result = indices;
+        std::vector<Collapse> collapses;
+        std::vector<uint32_t> adjacencyStart, adjacency;
+        std::vector<bool> touched;
+        std::vector<uint32_t> remap(vertexCount);
+        double maxCost = 0;
+
+        while (result.size() > targetIndexCount) {
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3) {
+                for (int e = 0; e < 3; e++) {
+                    uint32_t from = result[i + e];
+                    for (uint32_t to : { result[i + (e + 1) % 3], result[i + (e + 2) % 3] }) {
+                        uint32_t pu = position[from], pv = position[to];
+                        if (locked[pu] || pu == pv)
+                            continue;
+                        double cost = evaluate(sum(quadrics[pu], quadrics[pv]), glm::dvec3(positions[pv]));
+                        collapses.push_back({ from, to, cost });
+                    }
+                }
+            }
+            if (collapses.empty())
+                break;
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+            // triangles around each position, to reject collapses that flip one.
+            adjacencyStart.assign(vertexCount + 1, 0);
+            for (uint32_t index : result) {
+                adjacencyStart[position[index] + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                adjacencyStart[v + 1] += adjacencyStart[v];
+            }
+            adjacency.resize(result.size());
+            std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < result.size(); i++) {
+                adjacency[fill[position[result[i]]]++] = uint32_t(i / 3);
+            }
+
+            auto flips = [&](uint32_t pu, uint32_t pv) {
+                for (uint32_t k = adjacencyStart[pu]; k < adjacencyStart[pu + 1]; k++) {
+                    const uint32_t* triangle = &result[adjacency[k] * 3];
+                    glm::vec3 p[3], q[3];
+                    bool shared = false;
+                    for (int c = 0; c < 3; c++) {
+                        uint32_t at = position[triangle[c]];
+                        shared |= at == pv;
+                        p[c] = positions[at];
+                        q[c] = at == pu ? positions[pv] : p[c];
+                    }
+                    if (shared)
+                        continue; // collapses away
+                    glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                    if (glm::dot(before, after) <= 0.0f)
+                        return true;
+                }
+                return false;
+            };
+
+            // independent collapses: nothing in a collapsed vertex's ring moves in the same pass.
+            touched.assign(vertexCount, false);
+            for (uint32_t v = 0; v < vertexCount; v++) {
+                remap[v] = v;
+            }
+            size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+            size_t removed = 0;
+            for (const Collapse& c : collapses) {
+                uint32_t pu = position[c.from], pv = position[c.to];
+                if (touched[pu] || touched[pv] || flips(pu, pv))
+                    continue;
+                for (uint32_t k = adjacencyStart[pu]; k < adjacencyStart[pu + 1]; k++) {
+                    for (int corner = 0; corner < 3; corner++) {
+                        touched[position[result[adjacency[k] * 3 + corner]]] = true;
+                    }
+                }
+                // pu is unlocked, so c.from is its only vertex and one side of any seam at pv.
+                remap[c.from] = c.to;
+                quadrics[pv] = sum(quadrics[pu], quadrics[pv]);
+                maxCost = std::max(maxCost, c.cost);
+                removed += 2; // an interior edge takes two triangles with it
+                if (removed >= trianglesToRemove)
+                    break;
+            }
+            if (removed == 0)
+                break;
+
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3) {
+                uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+                if (position[a] == position[b] || position[b] == position[c] || position[a] == position[c])
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        *error = (float)std::sqrt(maxCost);
+        return result;
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/* Quadric error metric simplification (Garland and Heckbert) by collapsing
+ * vertices onto their neighbours, so the result indexes the same vertices
+ * and every level of detail can share one vertex buffer. Vertices sharing
+ * a position (uv or normal seams) and open borders never move, though
+ * their neighbours may collapse onto them, which keeps seams and
+ * silhouettes of open meshes intact. */
+namespace Simplify {
+    /* removes triangles until at most targetIndexCount indices are left or
+     * no collapse is possible. error receives the largest RMS distance of a
+     * collapsed vertex to its original planes, in the units of positions. */
+    std::vector<uint32_t> simplify(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+        size_t targetIndexCount, float* error);
+}
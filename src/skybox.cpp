@@ -8,32 +8,36 @@ void SkyboxMaterial::bake(const char* hdr, const char* lut) {
 }
 
 GLuint SkyboxRenderPass::vao;
-GLuint SkyboxRenderPass::skyboxprog;
-GLuint SkyboxRenderPass::uProj_Location;
-GLuint SkyboxRenderPass::uView_Location;
-GLuint SkyboxRenderPass::skybox_Location;
+ShaderProgram SkyboxRenderPass::skyboxprog;
+ShaderProgram::Uniform SkyboxRenderPass::uProj_Location;
+ShaderProgram::Uniform SkyboxRenderPass::uView_Location;
 
 SkyboxRenderPass::SkyboxRenderPass() {
     if (vao == 0) {
         glGenVertexArrays(1, &vao);
-        linkProgram(&skyboxprog,
+        linkProgramAsync(&skyboxprog,
             Shaders::skyboxVertexShader(),
-            Shaders::skyboxFragmentShader());
-        uProj_Location = glGetUniformLocation(skyboxprog, "uProj");
-        uView_Location = glGetUniformLocation(skyboxprog, "uView");
-        skybox_Location = glGetUniformLocation(skyboxprog, "skybox");
+            Shaders::skyboxFragmentShader(),
+            [] {
+                uProj_Location = skyboxprog.uniform("uProj");
+                uView_Location = skyboxprog.uniform("uView");
+                skyboxprog.use();
+                skyboxprog.set(skyboxprog.uniform("skybox"), 0);
+            });
     }
 }
 
 void SkyboxRenderPass::drawSkybox(Camera* camera, SkyboxMaterial* material) {
-    glUseProgram(skyboxprog);
-    glUniformMatrix4fv(uProj_Location, 1, GL_FALSE, &camera->projection[0][0]);
-    glUniformMatrix4fv(uView_Location, 1, GL_FALSE, &camera->view[0][0]);
-    glUniform1i(skybox_Location, 0);
+    finishProgram(&skyboxprog);
+    skyboxprog.use();
+    skyboxprog.set(uProj_Location, camera->projection);
+    skyboxprog.set(uView_Location, camera->view);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, material->getCubeMap());
     glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
     glBindVertexArray(vao);
     glDrawArrays(GL_TRIANGLES, 0, 36);
+    glDepthFunc(GL_LESS);
     glDepthMask(GL_TRUE);
 }
@@ -35,8 +35,7 @@ public:
 
 private:
     static GLuint vao;
-    static GLuint skyboxprog;
-    static GLuint uProj_Location;
-    static GLuint uView_Location;
-    static GLuint skybox_Location;
+    static ShaderProgram skyboxprog;
+    static ShaderProgram::Uniform uProj_Location;
+    static ShaderProgram::Uniform uView_Location;
 };
@@ -0,0 +1,101 @@
+#include "taa.h"
+#include "camera.h"
+#include "shaders.h"
+
+/* weight of the history; 1 - this is how much a new frame contributes. */
+constexpr float historyWeight = 0.9f;
+
+GLuint TemporalRenderPass::vao;
+ShaderProgram TemporalRenderPass::program;
+ShaderProgram::Uniform TemporalRenderPass::reprojection_Location;
+ShaderProgram::Uniform TemporalRenderPass::jitter_Location;
+ShaderProgram::Uniform TemporalRenderPass::historyWeight_Location;
+
+static float halton(unsigned index, unsigned base) {
+    float result = 0.0f, f = 1.0f;
+    for (; index > 0; index /= base) {
+        f /= base;
+        result += f * (index % base);
+    }
+    return result;
+}
+
+TemporalRenderPass::TemporalRenderPass()
+    : current(0)
+    , width(0)
+    , height(0)
+    , valid(false)
+    , frame(0)
+{
+    glGenTextures(2, history);
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, history[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    if (vao == 0) {
+        glGenVertexArrays(1, &vao);
+        linkProgramAsync(&program,
+            Shaders::fullscreenVertexShader(),
+            Shaders::taaFragmentShader(),
+            [] {
+                reprojection_Location = program.uniform("reprojection");
+                jitter_Location = program.uniform("jitter");
+                historyWeight_Location = program.uniform("historyWeight");
+                program.use();
+                program.set(program.uniform("current"), 0);
+                program.set(program.uniform("currentDepth"), 1);
+                program.set(program.uniform("history"), 2);
+            });
+    }
+}
+
+TemporalRenderPass::~TemporalRenderPass() {
+    glDeleteTextures(2, history);
+}
+
+glm::vec2 TemporalRenderPass::nextJitter(int width, int height) {
+    // Halton(2, 3) covers the pixel evenly over a short cycle.
+    unsigned i = frame % jitterPhases + 1;
+    glm::vec2 offset(halton(i, 2) - 0.5f, halton(i, 3) - 0.5f);
+    return offset * glm::vec2(2.0f / width, 2.0f / height);
+}
+
+void TemporalRenderPass::resize(int width, int height) {
+    if (width == this->width && height == this->height)
+        return;
+    this->width = width;
+    this->height = height;
+    valid = false;
+
+    // re-specified in place, so framebuffers holding these names stay valid.
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, history[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, historyFormat, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+}
+
+void TemporalRenderPass::draw(Camera* camera, GLuint color, GLuint depth) {
+    finishProgram(&program);
+    program.use();
+    glm::mat4 reprojection = camera->previousViewProjection * glm::inverse(camera->unjitteredProjection * camera->view);
+    program.set(reprojection_Location, reprojection);
+    program.set(jitter_Location, camera->jitter * 0.5f);
+    program.set(historyWeight_Location, valid ? historyWeight : 0.0f);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, color);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, history[current]);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    current ^= 1;
+    valid = true;
+    frame++;
+}
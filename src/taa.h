@@ -0,0 +1,46 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+#include "renderpass.h"
+
+class Camera;
+
+/* Temporal reconstruction. The scene is rendered with a different sub-pixel
+ * jitter every frame, possibly at a lower resolution; this pass reprojects
+ * last frame's output through the depth buffer, clamps it to the current
+ * neighbourhood and blends, accumulating the jittered samples over time.
+ * The two history textures alternate as source and target. */
+class TemporalRenderPass : public RenderPass {
+public:
+    static constexpr GLenum historyFormat = GL_RGBA16F;
+    static constexpr int jitterPhases = 8;
+
+    TemporalRenderPass();
+    ~TemporalRenderPass();
+
+    /* the NDC offset for the next frame, rendered at width x height. */
+    glm::vec2 nextJitter(int width, int height);
+
+    /* sizes the history to the output; call every frame before the graph is built. */
+    void resize(int width, int height);
+    void reset() { valid = false; }
+
+    GLuint getHistory() { return history[current]; }
+    GLuint getTarget() { return history[current ^ 1]; }
+
+    void draw(Camera* camera, GLuint color, GLuint depth);
+
+private:
+    GLuint history[2];
+    int current;
+    int width;
+    int height;
+    bool valid;
+    unsigned frame;
+
+    static GLuint vao;
+    static ShaderProgram program;
+    static ShaderProgram::Uniform reprojection_Location;
+    static ShaderProgram::Uniform jitter_Location;
+    static ShaderProgram::Uniform historyWeight_Location;
+};
@@ -0,0 +1,114 @@
+#include "texturecache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+constexpr uint32_t cacheMagic = 0x54445242; // "BRDT"
+constexpr uint32_t cacheVersion = 1;
+constexpr uint32_t maxCachedLevels = 32; // more than a 2^31 texel side needs
+
+namespace TextureCache {
+    std::string directory = "texturecache";
+
+    static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    static uint64_t hashSource(const char* path) {
+        std::error_code error;
+        uint64_t size = std::filesystem::file_size(path, error);
+        int64_t time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+        uint64_t key = 0xcbf29ce484222325ull;
+        key = hashBytes(key, path, strlen(path));
+        key = hashBytes(key, &size, sizeof(size));
+        key = hashBytes(key, &time, sizeof(time));
+        return key;
+    }
+
+    static std::string pathOf(uint64_t key) {
+        return path(key, ".tex");
+    }
+
+    std::string path(uint64_t key, const char* extension) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return directory + "/" + name + extension;
+    }
+
+    void setDirectory(const char* path) {
+        directory = path;
+    }
+
+    uint64_t makeKey(const char* path, Mipmap::Kind kind) {
+        uint64_t key = hashSource(path);
+        key = hashBytes(key, &kind, sizeof(kind));
+        key = hashBytes(key, &cacheVersion, sizeof(cacheVersion));
+        return key;
+    }
+
+    uint64_t makeKey(const char* path, const char* variant) {
+        uint64_t key = hashSource(path);
+        key = hashBytes(key, variant, strlen(variant));
+        key = hashBytes(key, &cacheVersion, sizeof(cacheVersion));
+        return key;
+    }
+
+    bool load(uint64_t key, std::vector<Mipmap::Level>& levels) {
+        levels.clear();
+        std::ifstream file(pathOf(key), std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        // every count and size is checked against what is left, so a corrupt entry cannot over-allocate.
+        uint64_t remaining = (uint64_t)file.tellg();
+        file.seekg(0);
+
+        uint32_t header[2];
+        if (remaining < sizeof(header) || !file.read((char*)header, sizeof(header)) || header[0] != cacheMagic)
+            return false;
+        if (header[1] == 0 || header[1] > maxCachedLevels)
+            return false;
+        remaining -= sizeof(header);
+
+        std::vector<Mipmap::Level> loaded(header[1]);
+        for (Mipmap::Level& level : loaded) {
+            int32_t size[2];
+            if (remaining < sizeof(size) || !file.read((char*)size, sizeof(size)))
+                return false;
+            remaining -= sizeof(size);
+            uint64_t bytes = uint64_t(size[0]) * uint64_t(size[1]) * 4;
+            if (size[0] <= 0 || size[1] <= 0 || bytes > remaining)
+                return false;
+            remaining -= bytes;
+
+            level.width = size[0];
+            level.height = size[1];
+            level.pixels.resize((size_t)bytes);
+            if (!file.read((char*)level.pixels.data(), level.pixels.size()))
+                return false;
+        }
+        levels.swap(loaded);
+        return true;
+    }
+
+    void store(uint64_t key, const std::vector<Mipmap::Level>& levels) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        std::ofstream file(pathOf(key), std::ios::binary);
+        uint32_t header[2] = { cacheMagic, (uint32_t)levels.size() };
+        file.write((const char*)header, sizeof(header));
+        for (const Mipmap::Level& level : levels) {
+            int32_t size[2] = { level.width, level.height };
+            file.write((const char*)size, sizeof(size));
+            file.write((const char*)level.pixels.data(), level.pixels.size());
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "mipmap.h"
+
+/* Disk cache of imported textures with their full mip chain, so that a
+ * warm start neither decodes the source image nor filters it. The key
+ * covers the source path, size and modification time and the mip kind. */
+namespace TextureCache {
+    void setDirectory(const char* path);
+    uint64_t makeKey(const char* path, Mipmap::Kind kind);
+    /* for entries derived from a source other than by filtering, e.g. baked maps. */
+    uint64_t makeKey(const char* path, const char* variant);
+    /* where an entry stored in another container, e.g. ".dds", lives. */
+    std::string path(uint64_t key, const char* extension);
+
+    /* false when the entry is missing or truncated. */
+    bool load(uint64_t key, std::vector<Mipmap::Level>& levels);
+    void store(uint64_t key, const std::vector<Mipmap::Level>& levels);
+}
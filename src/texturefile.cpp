@@ -0,0 +1,371 @@
+#include "texturefile.h"
+#include "dds.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+static const uint8_t ktxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint8_t ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct KTXHeader {
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+struct KTX2Header {
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint32_t sgdByteOffset[2]; // uint64, but only 4-byte aligned after the identifier
+    uint32_t sgdByteLength[2];
+};
+
+struct KTX2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+static_assert(sizeof(KTXHeader) == 52, "KTX header is 52 bytes");
+static_assert(sizeof(KTX2Header) == 68, "KTX2 header is 68 bytes");
+
+constexpr uint32_t ktxEndianness = 0x04030201;
+
+/* larger than any GL_MAX_TEXTURE_SIZE and GL_MAX_ARRAY_TEXTURE_LAYERS in use. */
+constexpr uint32_t maxSize = 1 << 16;
+constexpr uint32_t maxLayers = 2048;
+
+/* internal format, transfer format and type, and bytes per pixel or per block. */
+struct FormatInfo {
+    uint32_t dxgi;
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+    int bytes;
+};
+
+static const FormatInfo dxgiFormats[] = {
+    {  2, GL_RGBA32F, GL_RGBA, GL_FLOAT, 16 },
+    { 10, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8 },
+    { 11, GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 8 },
+    { 16, GL_RG32F, GL_RG, GL_FLOAT, 8 },
+    { 26, GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, 4 },
+    { 28, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+    { 29, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+    { 34, GL_RG16F, GL_RG, GL_HALF_FLOAT, 4 },
+    { 35, GL_RG16, GL_RG, GL_UNSIGNED_SHORT, 4 },
+    { 41, GL_R32F, GL_RED, GL_FLOAT, 4 },
+    { 49, GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2 },
+    { 54, GL_R16F, GL_RED, GL_HALF_FLOAT, 2 },
+    { 56, GL_R16, GL_RED, GL_UNSIGNED_SHORT, 2 },
+    { 61, GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1 },
+    { 87, GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE, 4 },
+    { 91, GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE, 4 },
+    { 71, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 0, 0, 8 },
+    { 72, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 0, 0, 8 },
+    { 74, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 0, 0, 16 },
+    { 75, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 0, 0, 16 },
+    { 77, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 0, 16 },
+    { 78, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 0, 0, 16 },
+    { 80, GL_COMPRESSED_RED_RGTC1, 0, 0, 8 },
+    { 81, GL_COMPRESSED_SIGNED_RED_RGTC1, 0, 0, 8 },
+    { 83, GL_COMPRESSED_RG_RGTC2, 0, 0, 16 },
+    { 84, GL_COMPRESSED_SIGNED_RG_RGTC2, 0, 0, 16 },
+    { 95, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB, 0, 0, 16 },
+    { 96, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB, 0, 0, 16 },
+    { 98, GL_COMPRESSED_RGBA_BPTC_UNORM_ARB, 0, 0, 16 },
+    { 99, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB, 0, 0, 16 },
+};
+
+/* pre-DX10 DDS formats: FourCCs, D3DFMT codes and plain RGBA masks, as DXGI. */
+static uint32_t legacyDDSFormat(const DDS::PixelFormat& pf)
+{
+    if (pf.flags & DDS::pixelFormatFourCC) {
+        switch (pf.fourCC) {
+        case DDS::fourCC('D', 'X', 'T', '1'): return 71;
+        case DDS::fourCC('D', 'X', 'T', '2'): return 74;
+        case DDS::fourCC('D', 'X', 'T', '3'): return 74;
+        case DDS::fourCC('D', 'X', 'T', '4'): return 77;
+        case DDS::fourCC('D', 'X', 'T', '5'): return 77;
+        case DDS::fourCC('A', 'T', 'I', '1'): return 80;
+        case DDS::fourCC('B', 'C', '4', 'U'): return 80;
+        case DDS::fourCC('B', 'C', '4', 'S'): return 81;
+        case DDS::fourCC('A', 'T', 'I', '2'): return 83;
+        case DDS::fourCC('B', 'C', '5', 'U'): return 83;
+        case DDS::fourCC('B', 'C', '5', 'S'): return 84;
+        case 36: return 11;  // D3DFMT_A16B16G16R16
+        case 111: return 54; // D3DFMT_R16F
+        case 112: return 34; // D3DFMT_G16R16F
+        case 113: return 10; // D3DFMT_A16B16G16R16F
+        case 114: return 41; // D3DFMT_R32F
+        case 115: return 16; // D3DFMT_G32R32F
+        case 116: return 2;  // D3DFMT_A32B32G32R32F
+        default: return 0;
+        }
+    }
+    if ((pf.flags & (DDS::pixelFormatRGB | DDS::pixelFormatLuminance)) && pf.bitCount == 32) {
+        if (pf.masks[0] == 0xFF && pf.masks[1] == 0xFF00 && pf.masks[2] == 0xFF0000)
+            return 28;
+        if (pf.masks[0] == 0xFF0000 && pf.masks[1] == 0xFF00 && pf.masks[2] == 0xFF)
+            return 87;
+    }
+    if ((pf.flags & (DDS::pixelFormatRGB | DDS::pixelFormatLuminance)) && pf.bitCount == 8 && pf.masks[0] == 0xFF)
+        return 61;
+    return 0;
+}
+
+/* the VkFormats of KTX2 files we can upload, as DXGI. */
+static uint32_t vkFormatToDXGI(uint32_t vkFormat)
+{
+    switch (vkFormat) {
+    case 9: return 61;   // R8_UNORM
+    case 16: return 49;  // R8G8_UNORM
+    case 37: return 28;  // R8G8B8A8_UNORM
+    case 43: return 29;  // R8G8B8A8_SRGB
+    case 44: return 87;  // B8G8R8A8_UNORM
+    case 50: return 91;  // B8G8R8A8_SRGB
+    case 70: return 56;  // R16_UNORM
+    case 76: return 54;  // R16_SFLOAT
+    case 77: return 35;  // R16G16_UNORM
+    case 83: return 34;  // R16G16_SFLOAT
+    case 91: return 11;  // R16G16B16A16_UNORM
+    case 97: return 10;  // R16G16B16A16_SFLOAT
+    case 100: return 41; // R32_SFLOAT
+    case 103: return 16; // R32G32_SFLOAT
+    case 109: return 2;  // R32G32B32A32_SFLOAT
+    case 122: return 26; // B10G11R11_UFLOAT_PACK32
+    case 131: case 133: return 71; // BC1_RGB(A)_UNORM
+    case 132: case 134: return 72; // BC1_RGB(A)_SRGB
+    case 135: return 74; // BC2_UNORM
+    case 136: return 75; // BC2_SRGB
+    case 137: return 77; // BC3_UNORM
+    case 138: return 78; // BC3_SRGB
+    case 139: return 80; // BC4_UNORM
+    case 140: return 81; // BC4_SNORM
+    case 141: return 83; // BC5_UNORM
+    case 142: return 84; // BC5_SNORM
+    case 143: return 95; // BC6H_UFLOAT
+    case 144: return 96; // BC6H_SFLOAT
+    case 145: return 98; // BC7_UNORM
+    case 146: return 99; // BC7_SRGB
+    default: return 0;
+    }
+}
+
+TextureFile::TextureFile(const char* path)
+    : path(path)
+    , file(path)
+    , internalFormat(0)
+    , format(0)
+    , type(0)
+    , bytes(0)
+    , width(0)
+    , height(0)
+    , levels(1)
+    , layers(1)
+    , faces(1)
+    , alignment(1)
+{
+    if (file.getSize() >= 4 && memcmp(file.getData(), &DDS::magic, 4) == 0) {
+        parseDDS();
+    } else if (file.getSize() >= 12 && memcmp(file.getData(), ktxIdentifier, 12) == 0) {
+        parseKTX();
+    } else if (file.getSize() >= 12 && memcmp(file.getData(), ktx2Identifier, 12) == 0) {
+        parseKTX2();
+    } else {
+        fail("not a DDS or KTX file");
+    }
+}
+
+void TextureFile::fail(const char* reason) const {
+    throw std::runtime_error(path + ": " + reason);
+}
+
+const uint8_t* TextureFile::range(size_t offset, size_t size) const {
+    if (offset > file.getSize() || size > file.getSize() - offset)
+        fail("truncated");
+    return file.getData() + offset;
+}
+
+void TextureFile::setDXGIFormat(uint32_t dxgi) {
+    for (const FormatInfo& info : dxgiFormats) {
+        if (info.dxgi == dxgi) {
+            internalFormat = info.internalFormat;
+            format = info.format;
+            type = info.type;
+            bytes = info.bytes;
+            return;
+        }
+    }
+    fail("unsupported format");
+}
+
+void TextureFile::setSize(uint32_t width, uint32_t height, uint32_t levels, uint32_t layers, uint32_t faces) {
+    if (width == 0 || height == 0 || width > maxSize || height > maxSize)
+        fail("bad dimensions");
+    uint32_t maxLevels = 1;
+    while ((std::max(width, height) >> maxLevels) != 0)
+        maxLevels++;
+    if (levels == 0 || levels > maxLevels)
+        fail("bad mip level count");
+    if (layers == 0 || layers > maxLayers)
+        fail("bad array layer count");
+    if (faces != 1 && faces != 6)
+        fail("bad face count");
+
+    this->width = int(width);
+    this->height = int(height);
+    this->levels = int(levels);
+    this->layers = int(layers);
+    this->faces = int(faces);
+}
+
+size_t TextureFile::imageSize(int level) const {
+    int w = std::max(1, width >> level);
+    int h = std::max(1, height >> level);
+    if (isCompressed())
+        return size_t((w + 3) / 4) * ((h + 3) / 4) * bytes;
+    return size_t(w) * h * bytes;
+}
+
+void TextureFile::parseDDS() {
+    DDS::Header header;
+    memcpy(&header, range(4, sizeof(header)), sizeof(header));
+    if (header.size != sizeof(DDS::Header))
+        fail("bad DDS header");
+    size_t offset = 4 + sizeof(header);
+
+    uint32_t levelCount = (header.flags & DDS::flagMipMapCount) ? std::max(1u, header.mipMapCount) : 1;
+    uint32_t layerCount = 1, faceCount = 1;
+
+    if (header.pixelFormat.fourCC == DDS::fourCC('D', 'X', '1', '0')) {
+        DDS::HeaderDX10 dx10;
+        memcpy(&dx10, range(offset, sizeof(dx10)), sizeof(dx10));
+        offset += sizeof(dx10);
+        if (dx10.dimension != DDS::dimensionTexture2D && dx10.dimension != DDS::dimensionTexture1D)
+            fail("volume textures are not supported");
+        setDXGIFormat(dx10.format);
+        faceCount = (dx10.miscFlag & DDS::miscTextureCube) ? 6 : 1;
+        layerCount = std::max(1u, dx10.arraySize);
+    } else {
+        if (header.caps[1] & DDS::caps2Volume)
+            fail("volume textures are not supported");
+        setDXGIFormat(legacyDDSFormat(header.pixelFormat));
+        faceCount = (header.caps[1] & DDS::caps2CubeMap) ? 6 : 1;
+    }
+    setSize(header.width, std::max(1u, header.height), levelCount, layerCount, faceCount);
+
+    // layer by layer, face by face, each with its whole mip chain.
+    images.resize(size_t(levels) * layers * faces);
+    for (int layer = 0; layer < layers; layer++) {
+        for (int face = 0; face < faces; face++) {
+            for (int level = 0; level < levels; level++) {
+                size_t size = imageSize(level);
+                Image& image = images[(size_t(level) * layers + layer) * faces + face];
+                image.data = range(offset, size);
+                image.size = size;
+                image.width = std::max(1, width >> level);
+                image.height = std::max(1, height >> level);
+                offset += size;
+            }
+        }
+    }
+}
+
+void TextureFile::parseKTX() {
+    KTXHeader header;
+    memcpy(&header, range(12, sizeof(header)), sizeof(header));
+    if (header.endianness != ktxEndianness)
+        fail("big-endian KTX is not supported");
+    if (header.pixelDepth > 1)
+        fail("volume textures are not supported");
+
+    internalFormat = header.glInternalFormat;
+    format = header.glType == 0 ? 0 : header.glFormat;
+    type = header.glType;
+    setSize(header.pixelWidth, std::max(1u, header.pixelHeight), std::max(1u, header.numberOfMipmapLevels),
+        std::max(1u, header.numberOfArrayElements), std::max(1u, header.numberOfFaces));
+    alignment = 4; // KTX pads rows to 4 bytes, like GL's default
+
+    // per level its size, then layer by layer and face by face, padded to 4 bytes.
+    size_t offset = 12 + sizeof(header) + header.bytesOfKeyValueData;
+    bool cube = faces == 6 && header.numberOfArrayElements == 0;
+    images.resize(size_t(levels) * layers * faces);
+    for (int level = 0; level < levels; level++) {
+        uint32_t levelSize;
+        memcpy(&levelSize, range(offset, 4), 4);
+        offset += 4;
+
+        // for a single cube map the size is of one face, otherwise of the whole level.
+        size_t size = cube ? levelSize : levelSize / (size_t(layers) * faces);
+        for (int layer = 0; layer < layers; layer++) {
+            for (int face = 0; face < faces; face++) {
+                Image& image = images[(size_t(level) * layers + layer) * faces + face];
+                image.data = range(offset, size);
+                image.size = size;
+                image.width = std::max(1, width >> level);
+                image.height = std::max(1, height >> level);
+                offset += cube ? (size + 3) & ~size_t(3) : size;
+            }
+        }
+        offset = (offset + 3) & ~size_t(3);
+    }
+}
+
+void TextureFile::parseKTX2() {
+    KTX2Header header;
+    memcpy(&header, range(12, sizeof(header)), sizeof(header));
+    if (header.supercompressionScheme != 0)
+        fail("supercompressed KTX2 is not supported");
+    if (header.pixelDepth > 1)
+        fail("volume textures are not supported");
+
+    setDXGIFormat(vkFormatToDXGI(header.vkFormat));
+    setSize(header.pixelWidth, std::max(1u, header.pixelHeight), std::max(1u, header.levelCount),
+        std::max(1u, header.layerCount), std::max(1u, header.faceCount));
+
+    // the level index follows the header; each level holds its layers and faces back to back.
+    size_t index = 12 + sizeof(header);
+    images.resize(size_t(levels) * layers * faces);
+    for (int level = 0; level < levels; level++) {
+        KTX2Level entry;
+        memcpy(&entry, range(index + level * sizeof(entry), sizeof(entry)), sizeof(entry));
+        size_t size = imageSize(level);
+        if (entry.byteLength < size * layers * faces)
+            fail("truncated");
+
+        size_t offset = (size_t)entry.byteOffset;
+        for (int layer = 0; layer < layers; layer++) {
+            for (int face = 0; face < faces; face++) {
+                Image& image = images[(size_t(level) * layers + layer) * faces + face];
+                image.data = range(offset, size);
+                image.size = size;
+                image.width = std::max(1, width >> level);
+                image.height = std::max(1, height >> level);
+                offset += size;
+            }
+        }
+    }
+}
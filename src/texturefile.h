@@ -0,0 +1,71 @@
+#pragma once
+#include <glad.h>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+
+/* A prebaked texture in a DDS (with or without the DX10 header), KTX or
+ * KTX2 container, recognized by its magic. The file is mapped rather than
+ * read and every image points into the mapping, so uploads go straight
+ * from the page cache to the driver. Mip levels, array layers and cube
+ * faces are supported, volumes and supercompressed KTX2 are not. */
+class TextureFile {
+public:
+    struct Image {
+        const uint8_t* data;
+        size_t size;
+        int width;
+        int height;
+    };
+
+    /* throws std::runtime_error on a missing, malformed or unsupported file. */
+    explicit TextureFile(const char* path);
+
+    GLenum getInternalFormat() const { return internalFormat; }
+    /* the pixel transfer format and type, 0 for compressed formats. */
+    GLenum getFormat() const { return format; }
+    GLenum getType() const { return type; }
+    bool isCompressed() const { return format == 0; }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getLevels() const { return levels; }
+    int getLayers() const { return layers; }
+    int getFaces() const { return faces; }
+    /* GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_2D. */
+    GLenum getTarget() const { return faces == 6 ? GL_TEXTURE_CUBE_MAP : layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D; }
+    /* the GL_UNPACK_ALIGNMENT matching the container's row padding. */
+    int getAlignment() const { return alignment; }
+
+    const Image& getImage(int level, int layer = 0, int face = 0) const {
+        return images[(size_t(level) * layers + layer) * faces + face];
+    }
+
+private:
+    void parseDDS();
+    void parseKTX();
+    void parseKTX2();
+    void setDXGIFormat(uint32_t dxgi);
+    /* checks the header's counts before anything is allocated from them. */
+    void setSize(uint32_t width, uint32_t height, uint32_t levels, uint32_t layers, uint32_t faces);
+    size_t imageSize(int level) const;
+    const uint8_t* range(size_t offset, size_t size) const;
+    [[noreturn]] void fail(const char* reason) const;
+
+private:
+    std::string path;
+    MappedFile file;
+
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+    int bytes; // per pixel, or per 4x4 block of a compressed format
+
+    int width;
+    int height;
+    int levels;
+    int layers;
+    int faces;
+    int alignment;
+    std::vector<Image> images;
+};
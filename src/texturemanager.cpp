@@ -0,0 +1,223 @@
+#include "texturemanager.h"
+#include "renderpass.h"
+#include "texturecache.h"
+#include "mappedfile.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+namespace TextureManager {
+    struct Entry {
+        std::string name;
+        std::vector<std::string> keys; // byName keys resolving to this texture
+        uint64_t content;
+        size_t bytes;
+        int refs;
+    };
+
+    static std::unordered_map<std::string, GLuint> byName;
+    static std::unordered_map<uint64_t, GLuint> byContent;
+    static std::unordered_map<GLuint, Entry> entries;
+    static std::unordered_map<uint64_t, uint64_t> contentHashes; // by TextureCache key
+    static size_t hits;
+    static size_t savedBytes;
+
+    static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    /* the hash of the file's bytes, memoized under its TextureCache key (path,
+     * size and modification time) in memory and as a .hash file next to the
+     * cache entries, so each version of a file is read for hashing once. */
+    static uint64_t hashContents(const char* path) {
+        uint64_t key = TextureCache::makeKey(path, "content");
+        auto known = contentHashes.find(key);
+        if (known != contentHashes.end())
+            return known->second;
+
+        uint64_t hash;
+        std::string memo = TextureCache::path(key, ".hash");
+        std::ifstream cached(memo, std::ios::binary);
+        if (!cached.read((char*)&hash, sizeof(hash))) {
+            MappedFile file(path);
+            hash = hashBytes(0xcbf29ce484222325ull, file.getData(), file.getSize());
+            std::error_code error;
+            std::filesystem::create_directories(std::filesystem::path(memo).parent_path(), error);
+            std::ofstream(memo, std::ios::binary).write((const char*)&hash, sizeof(hash));
+        }
+        contentHashes[key] = hash;
+        return hash;
+    }
+
+    static uint64_t hashFile(uint64_t hash, const char* path) {
+        if (!path)
+            return hashBytes(hash, "", 1);
+        uint64_t contents = hashContents(path);
+        return hashBytes(hash, &contents, sizeof(contents));
+    }
+
+    /* what the driver allocated for every level, from its own reports. Cube
+     * maps are queried through one face; an array's compressed size already
+     * covers its layers. */
+    static size_t measure(GLuint texture, GLenum target) {
+        glBindTexture(target, texture);
+        GLenum query = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+        size_t faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+        size_t bytes = 0;
+        for (GLint level = 0; ; level++) {
+            GLint width = 0, height = 0, depth = 1, compressed = 0;
+            glGetTexLevelParameteriv(query, level, GL_TEXTURE_WIDTH, &width);
+            if (width == 0)
+                break;
+            glGetTexLevelParameteriv(query, level, GL_TEXTURE_HEIGHT, &height);
+            if (target == GL_TEXTURE_2D_ARRAY) {
+                glGetTexLevelParameteriv(query, level, GL_TEXTURE_DEPTH, &depth);
+            }
+            glGetTexLevelParameteriv(query, level, GL_TEXTURE_COMPRESSED, &compressed);
+            if (compressed) {
+                GLint size = 0;
+                glGetTexLevelParameteriv(query, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                bytes += size_t(size) * faces;
+            } else {
+                const GLenum channels[4] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE };
+                GLint bits = 0;
+                for (GLenum channel : channels) {
+                    GLint size = 0;
+                    glGetTexLevelParameteriv(query, level, channel, &size);
+                    bits += size;
+                }
+                bytes += size_t(width) * height * depth * faces * bits / 8;
+            }
+        }
+        return bytes;
+    }
+
+    static GLuint shared(GLuint texture) {
+        hits++;
+        savedBytes += entries[texture].bytes;
+        return texture;
+    }
+
+    static GLuint findByName(const std::string& name) {
+        auto named = byName.find(name);
+        return named != byName.end() ? shared(named->second) : 0;
+    }
+
+    /* the name becomes another key of a texture with the same contents. */
+    static GLuint findByContent(const std::string& name, uint64_t content) {
+        auto same = byContent.find(content);
+        if (same == byContent.end())
+            return 0;
+        byName[name] = same->second;
+        entries[same->second].keys.push_back(name);
+        return shared(same->second);
+    }
+
+    static GLuint add(const std::string& name, uint64_t content, GLuint texture, GLenum target = GL_TEXTURE_2D) {
+        Entry& entry = entries[texture];
+        entry.name = name;
+        entry.keys.push_back(name);
+        entry.content = content;
+        entry.bytes = measure(texture, target);
+        entry.refs = 0;
+        byName[name] = texture;
+        byContent[content] = texture;
+        return texture;
+    }
+
+    GLuint load(const char* path, Mipmap::Kind kind) {
+        // the kind is part of both keys: the same file as color and as data are two textures.
+        std::string name = std::filesystem::path(path).lexically_normal().string() + "#" + std::to_string(kind);
+        if (GLuint texture = findByName(name))
+            return texture;
+
+        uint64_t content = hashFile(hashBytes(0xcbf29ce484222325ull, &kind, sizeof(kind)), path);
+        if (GLuint texture = findByContent(name, content))
+            return texture;
+        GLenum target;
+        GLuint texture = RenderPass::loadTexture(path, kind, &target);
+        return add(name, content, texture, target);
+    }
+
+    GLuint loadORM(const char* occlusion, const char* roughness, const char* metallic) {
+        std::string name = "orm:";
+        for (const char* path : { occlusion, roughness, metallic }) {
+            name += path ? std::filesystem::path(path).lexically_normal().string() : "-";
+            name += "|";
+        }
+        if (GLuint texture = findByName(name))
+            return texture;
+
+        uint64_t content = hashBytes(0xcbf29ce484222325ull, "orm", 3);
+        for (const char* path : { occlusion, roughness, metallic }) {
+            content = hashFile(content, path);
+        }
+        if (GLuint texture = findByContent(name, content))
+            return texture;
+        GLenum target;
+        GLuint texture = RenderPass::loadORM(occlusion, roughness, metallic, &target);
+        return add(name, content, texture, target);
+    }
+
+    GLuint constant(unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+        char name[32];
+        snprintf(name, sizeof(name), "constant:%02x%02x%02x%02x", r, g, b, a);
+        if (GLuint texture = findByName(name))
+            return texture;
+
+        uint8_t color[4] = { r, g, b, a };
+        uint64_t content = hashBytes(0xcbf29ce484222325ull, color, sizeof(color));
+        return add(name, content, RenderPass::makeTexture(r, g, b, a));
+    }
+
+    void retain(GLuint texture) {
+        auto entry = entries.find(texture);
+        if (entry != entries.end()) {
+            entry->second.refs++;
+        }
+    }
+
+    void release(GLuint texture) {
+        auto entry = entries.find(texture);
+        if (entry == entries.end() || --entry->second.refs > 0)
+            return;
+
+        for (const std::string& key : entry->second.keys) {
+            byName.erase(key);
+        }
+        byContent.erase(entry->second.content);
+        entries.erase(entry);
+        glDeleteTextures(1, &texture);
+    }
+
+    size_t getMemory() {
+        size_t bytes = 0;
+        for (const auto& entry : entries) {
+            bytes += entry.second.bytes;
+        }
+        return bytes;
+    }
+
+    void report() {
+        std::vector<const Entry*> sorted;
+        for (const auto& entry : entries) {
+            sorted.push_back(&entry.second);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const Entry* a, const Entry* b) { return a->bytes > b->bytes; });
+
+        printf("textures: %zu, %.1f MiB\n", sorted.size(), getMemory() / 1048576.0);
+        for (const Entry* entry : sorted) {
+            printf("  %8.1f KiB  %2d refs  %s\n", entry->bytes / 1024.0, entry->refs, entry->name.c_str());
+        }
+        printf("  %zu loads shared an existing texture, saving %.1f MiB\n", hits, savedBytes / 1048576.0);
+    }
+}
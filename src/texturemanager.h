@@ -0,0 +1,26 @@
+#pragma once
+#include <glad.h>
+#include <cstddef>
+#include "mipmap.h"
+
+/* Registry of material textures. Loads are interned, first by path and
+ * then by a hash of the file contents, so a map shared by many materials
+ * (or copied under another name) is uploaded once, and constant colors
+ * share one 1x1 texture each. The content hash is kept per file version,
+ * so a file is only read for it once. Holders such as PBRMaterial retain
+ * and release what they use; a texture is deleted when its last holder
+ * lets go. Textures not created here pass through retain/release untouched. */
+namespace TextureManager {
+    GLuint load(const char* path, Mipmap::Kind kind = Mipmap::Linear);
+    /* see RenderPass::loadORM; occlusion and metallic may be null. */
+    GLuint loadORM(const char* occlusion, const char* roughness, const char* metallic);
+    GLuint constant(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+
+    void retain(GLuint texture);
+    void release(GLuint texture);
+
+    /* bytes of video memory held by the registered textures. */
+    size_t getMemory();
+    /* prints the textures, their holders and sizes and what interning saved. */
+    void report();
+}
@@ -0,0 +1,30 @@
+#include "timer.h"
+
+GPUTimer::GPUTimer()
+    : pending()
+    , frame(0)
+    , average(0)
+{
+    glGenQueries(latency, queries);
+}
+
+GPUTimer::~GPUTimer() {
+    glDeleteQueries(latency, queries);
+}
+
+void GPUTimer::begin() {
+    int i = frame % latency;
+    if (pending[i]) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+        float ms = elapsed / 1e6f;
+        average = average == 0 ? ms : average * 0.95f + ms * 0.05f;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+}
+
+void GPUTimer::end() {
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[frame % latency] = true;
+    frame++;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <glad.h>
+
+/* Measures GPU time between begin() and end() with GL_TIME_ELAPSED queries.
+ * Results are read a few frames late so that the CPU never waits on them. */
+class GPUTimer {
+public:
+    GPUTimer();
+    ~GPUTimer();
+
+    void begin();
+    void end();
+
+    float getMilliseconds() { return average; }
+
+private:
+    static constexpr int latency = 4;
+    GLuint queries[latency];
+    bool pending[latency];
+    int frame;
+    float average;
+};
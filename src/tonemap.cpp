@@ -0,0 +1,34 @@
+#include "tonemap.h"
+
+GLuint TonemapRenderPass::vao;
+TonemapRenderPass::Program TonemapRenderPass::programs[Shaders::SampleCountCount];
+
+TonemapRenderPass::TonemapRenderPass()
+    : exposure(1.0f)
+{
+    if (vao == 0) {
+        glGenVertexArrays(1, &vao);
+        for (unsigned s = 0; s < Shaders::SampleCountCount; s++) {
+            Program* p = &programs[s];
+            linkProgramAsync(&p->program,
+                Shaders::fullscreenVertexShader(),
+                Shaders::tonemapFragmentShader(Shaders::SampleCount(s)),
+                [p] {
+                    p->exposure_Location = p->program.uniform("exposure");
+                    p->program.use();
+                    p->program.set(p->program.uniform("hdr"), 0);
+                });
+        }
+    }
+}
+
+void TonemapRenderPass::draw(GLuint hdr, Shaders::SampleCount samples) {
+    Program& p = programs[samples];
+    finishProgram(&p.program);
+    p.program.use();
+    p.program.set(p.exposure_Location, exposure);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(samples > Shaders::Samples1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D, hdr);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <glad.h>
+#include "renderpass.h"
+#include "shaders.h"
+
+/* Final pass. The scene is shaded into a linear HDR target; this maps it
+ * to [0, 1] with exposure and Reinhard, and the sRGB backbuffer encodes.
+ * A multisampled target is resolved here, one tonemapped sample at a time. */
+class TonemapRenderPass : public RenderPass {
+public:
+    static constexpr GLenum hdrFormat = GL_R11F_G11F_B10F;
+    static constexpr GLenum depthFormat = GL_DEPTH_COMPONENT24;
+    static constexpr GLenum ldrFormat = GL_SRGB8_ALPHA8;
+
+    TonemapRenderPass();
+    void draw(GLuint hdr, Shaders::SampleCount samples = Shaders::Samples1);
+
+    void setExposure(float exposure) { this->exposure = exposure; }
+    float getExposure() { return exposure; }
+
+private:
+    struct Program {
+        ShaderProgram program;
+        ShaderProgram::Uniform exposure_Location;
+    };
+
+    float exposure;
+
+    static GLuint vao;
+    static Program programs[Shaders::SampleCountCount];
+};
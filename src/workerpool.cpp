@@ -0,0 +1,68 @@
+#include "workerpool.h"
+
+WorkerPool::WorkerPool()
+    : job(nullptr)
+    , parts(0)
+    , generation(0)
+    , pending(0)
+    , quit(false)
+{ }
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::work(size_t worker)
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&] { return quit || generation != seen; });
+        if (quit)
+            return;
+        seen = generation;
+        size_t part = worker + 1;
+        if (part >= parts)
+            continue;
+
+        lock.unlock();
+        (*job)(part);
+        lock.lock();
+        if (--pending == 0) {
+            done.notify_one();
+        }
+    }
+}
+
+void WorkerPool::run(size_t parts, const std::function<void(size_t)>& job)
+{
+    if (parts <= 1) {
+        if (parts == 1)
+            job(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (threads.size() + 1 < parts) {
+            threads.emplace_back([this, w = threads.size()] { work(w); });
+        }
+        this->job = &job;
+        this->parts = parts;
+        pending = parts - 1;
+        generation++;
+    }
+    wake.notify_all();
+    job(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == 0; });
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+/* Worker threads that outlive the jobs they run, so work split every
+ * frame does not start and join threads every frame. The pool grows to
+ * the largest job it has seen and the workers sleep in between. */
+class WorkerPool {
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    /* calls job(part) for every part in [0, parts): part 0 on the calling
+     * thread, the rest on workers, and returns once all of them are done. */
+    void run(size_t parts, const std::function<void(size_t)>& job);
+
+private:
+    void work(size_t worker);
+
+private:
+    std::vector<std::thread> threads; // worker w runs part w + 1
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* job;
+    size_t parts;
+    uint64_t generation;
+    size_t pending;
+    bool quit;
+};
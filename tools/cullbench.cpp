@@ -0,0 +1,71 @@
+// Times Culling::cull over 10k, 100k and 1M random boxes, on one thread and on all of them.
+//
+//   cullbench [iterations]
+
+#include "culling.h"
+
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Gribb/Hartmann, as in Camera::update.
+static void extractPlanes(const glm::mat4& m, glm::vec4 planes[6])
+{
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            glm::vec4 plane;
+            for (int k = 0; k < 4; k++) {
+                plane[k] = m[k][3] + (j == 0 ? m[k][i] : -m[k][i]);
+            }
+            planes[i*2 + j] = plane / glm::length(glm::vec3(plane));
+        }
+    }
+}
+
+static double timeCull(Culling& culling, const glm::vec4 planes[6], int iterations, size_t* visible)
+{
+    culling.cull(planes); // warm up, and start the workers
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        *visible = culling.cull(planes).size();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 100;
+    if (iterations < 1)
+        iterations = 1;
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    glm::vec4 planes[6];
+    extractPlanes(projection * view, planes);
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t count : { size_t(10000), size_t(100000), size_t(1000000) }) {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+        std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+        Culling culling;
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 center(position(random), position(random), position(random));
+            glm::vec3 extent(size(random));
+            culling.add(center - extent, center + extent);
+        }
+
+        size_t visible = 0;
+        culling.setThreads(1);
+        double single = timeCull(culling, planes, iterations, &visible);
+        culling.setThreads(threads);
+        double pooled = timeCull(culling, planes, iterations, &visible);
+        printf("%8zu objects, %7zu visible: %8.3f ms on 1 thread, %8.3f ms on %u\n",
+            count, visible, single, pooled, threads);
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+/* Offline block compression of material maps: writes a DDS with the full
+ * mip chain next to the source image, which RenderPass::loadTexture then
+ * prefers over the source. Environment maps need no conversion here, the
+ * runtime stores its baked cubes as BC6H in the texture cache. */
+#include "mipmap.h"
+#include "bc.h"
+#include "dds.h"
+#include "orm.h"
+
+#include <stb_image.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <filesystem>
+#include <stdexcept>
+
+struct Mode {
+    const char* name;
+    Mipmap::Kind kind;
+    DDS::Format format;
+};
+
+static const Mode modes[] = {
+    { "albedo", Mipmap::SRGB, DDS::BC7_SRGB },     // color, alpha kept
+    { "albedo-bc1", Mipmap::SRGB, DDS::BC1_SRGB }, // color without alpha, half the size of BC7
+    { "albedo-bc3", Mipmap::SRGB, DDS::BC3_SRGB }, // color with alpha, for drivers without BPTC
+    { "normal", Mipmap::Normal, DDS::BC5 },        // x and y, z is reconstructed in the shader
+    { "scalar", Mipmap::Linear, DDS::BC4 },        // the red channel: metallic, roughness, ...
+    { "orm", Mipmap::Linear, DDS::BC7 },           // <occlusion|-> <roughness> <metallic|-> packed by ORM
+};
+
+static BC::Format encoderFormat(DDS::Format format)
+{
+    switch (format) {
+    case DDS::BC1: case DDS::BC1_SRGB: return BC::BC1;
+    case DDS::BC3: case DDS::BC3_SRGB: return BC::BC3;
+    case DDS::BC4: return BC::BC4;
+    case DDS::BC5: return BC::BC5;
+    default: return BC::BC7;
+    }
+}
+
+static void compress(const std::string& output, std::vector<Mipmap::Level>& levels, const Mode& mode)
+{
+    Mipmap::generate(levels, mode.kind);
+
+    DDS::Image image;
+    image.format = mode.format;
+    image.width = levels[0].width;
+    image.height = levels[0].height;
+    image.levels = (int)levels.size();
+    for (const Mipmap::Level& level : levels) {
+        std::vector<uint8_t> blocks = BC::compress(level, encoderFormat(mode.format));
+        image.data.insert(image.data.end(), blocks.begin(), blocks.end());
+    }
+
+    DDS::write(output.c_str(), image);
+    printf("%s: %dx%d, %d levels, %zu KiB -> %zu KiB\n", output.c_str(), image.width, image.height, image.levels,
+        size_t(image.width) * image.height * 4 * 4 / 3 / 1024, image.data.size() / 1024);
+}
+
+static void convert(const char* path, const Mode& mode)
+{
+    int width, height, channels;
+    // bottom-up like the runtime loads it, so the DDS uploads the same way.
+    stbi_set_flip_vertically_on_load(true);
+    stbi_uc* pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error(path);
+    }
+
+    std::vector<Mipmap::Level> levels(1);
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].pixels.assign(pixels, pixels + size_t(width) * height * 4);
+    stbi_image_free(pixels);
+
+    compress(std::filesystem::path(path).replace_extension(".dds").string(), levels, mode);
+}
+
+static const char* optionalPath(const char* arg)
+{
+    return strcmp(arg, "-") == 0 ? nullptr : arg;
+}
+
+int main(int argc, char** argv)
+{
+    const Mode* mode = nullptr;
+    if (argc >= 3) {
+        for (const Mode& m : modes) {
+            if (strcmp(argv[1], m.name) == 0)
+                mode = &m;
+        }
+    }
+    if (!mode) {
+        printf("usage: texconv <mode> <image>...\nmodes:");
+        for (const Mode& m : modes) {
+            printf(" %s", m.name);
+        }
+        printf("\n");
+        return 1;
+    }
+
+    try {
+        if (strcmp(mode->name, "orm") == 0) {
+            if (argc != 5) {
+                printf("usage: texconv orm <occlusion|-> <roughness> <metallic|->\n");
+                return 1;
+            }
+            const char* occlusion = optionalPath(argv[2]);
+            const char* metallic = optionalPath(argv[4]);
+            std::vector<Mipmap::Level> levels(1, ORM::pack(occlusion, argv[3], metallic));
+            compress(ORM::compressedPath(argv[3]), levels, *mode);
+        } else {
+            for (int i = 2; i < argc; i++) {
+                convert(argv[i], *mode);
+            }
+        }
+    } catch (const std::exception& e) {
+        printf("texconv: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}